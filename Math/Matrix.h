@@ -1,32 +1,91 @@
 #ifndef MATRIX_H
 #define MATRIX_H
 
+#include "allocation.h"
+#include "parallel.h"
+
+#include <functional>
+#include <memory>
+#include <stddef.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// matrices with up to this many elements keep them inside the object
+#ifndef MATH_MATRIX_INLINE_ELEMENTS
+#define MATH_MATRIX_INLINE_ELEMENTS 16
+#endif
+
 namespace Math
 {
+	// Memory owned outside matrix<T>, adopted without a copy: rows of at
+	// least columns elements, leading_dimension elements apart (0 means
+	// packed rows). A matrix over it never reallocates it; copies and
+	// results of another shape get storage of their own. When the matrix
+	// lets go of the buffer, deleter (if any) is called with data.
+	template <typename T> struct external_buffer
+	{
+	public:
+		T* data;
+		size_t leading_dimension;
+		std::function<void(T*)> deleter;
+
+	public:
+		external_buffer(T* data, size_t leading_dimension = 0u, std::function<void(T*)> deleter = nullptr)
+			: data(data)
+			, leading_dimension(leading_dimension)
+			, deleter(std::move(deleter))
+		{}
+
+		// takes the vector over, it lives until the matrix lets go of it
+		static external_buffer FromVector(std::vector<T>&& elements, size_t leading_dimension = 0u)
+		{
+			std::shared_ptr<std::vector<T>> holder = std::make_shared<std::vector<T>>(std::move(elements));
+			T* data = holder->data();
+			return external_buffer(data, leading_dimension, [holder](T*) mutable { holder.reset(); });
+		}
+	};
+
 	template <class T> class matrix
 	{
 	private:
 		typedef unsigned int uint;
+		static constexpr size_t inline_capacity = MATH_MATRIX_INLINE_ELEMENTS;
+
 		size_t rows, columns;
+		size_t stride = 0;	// elements between rows, columns unless external
 		T *storage = nullptr;
 		T default_value;
+		T inline_storage[inline_capacity];
+		allocation_policy policy;
+		bool paged = false;
+		bool external = false;
+		std::function<void(T*)> deleter;
 
 
 	public:
 		matrix(const matrix<T>& M)
-			:rows(M.rows), columns(M.columns), default_value(M.default_value)
+			:rows(M.rows), columns(M.columns), stride(M.columns), default_value(M.default_value), policy(M.policy)
 		{
-			storage = new T[rows * columns];
+			storage = Allocate(rows * columns, paged);
 			*this = M;
 		}
 		matrix(matrix<T>&& M)
-			: rows(M.rows), columns(M.columns), default_value(M.default_value)
+			: rows(M.rows), columns(M.columns), default_value(M.default_value), policy(M.policy)
 		{
-			storage = M.storage;
-			M.storage = nullptr;
-
-			M.rows = 0;
-			M.columns = 0;
+			TakeStorage(M);
+		}
+		// over external memory of at least rows * leading dimension
+		// elements, which keeps its contents
+		matrix(unsigned int rows, unsigned int columns, external_buffer<T> buffer, T default_value = (T)0.0)
+			: rows(rows < 1 ? 1 : rows)
+			, columns(columns < 1 ? 1 : columns)
+			, storage(buffer.data)
+			, default_value(default_value)
+			, external(true)
+			, deleter(std::move(buffer.deleter))
+		{
+			stride = buffer.leading_dimension < this->columns ? this->columns : buffer.leading_dimension;
 		}
 		matrix(unsigned int rows, unsigned int columns, T default_value = (T)0.0)
 		{
@@ -35,9 +94,10 @@ namespace Math
 
 			this->rows = rows;
 			this->columns = columns;
+			this->stride = columns;
 			this->default_value = default_value;
 
-			storage = new T[rows * columns];
+			storage = Allocate(this->rows * this->columns, paged);
 			for (unsigned int i = 0; i < rows; i++)
 			{
 				for (unsigned int j = 0; j < columns; j++)
@@ -46,9 +106,42 @@ namespace Math
 				}
 			}
 		}
+		// storage of large matrices obtained according to policy, see
+		// allocation_policy; copies keep the policy of their source
+		matrix(unsigned int rows, unsigned int columns, const allocation_policy& policy, T default_value = (T)0.0)
+			: policy(policy)
+		{
+			if (rows < 1) rows = 1;
+			if (columns < 1) columns = 1;
+
+			this->rows = rows;
+			this->columns = columns;
+			this->stride = columns;
+			this->default_value = default_value;
+
+			storage = Allocate(this->rows * this->columns, paged);
+			if (paged && policy.first_touch)
+			{
+				// every row block is first written by a pool thread
+				T* const data = storage;
+				const size_t n = this->columns;
+				ParallelFor(this->rows, FirstTouchRows(n * sizeof(T)), [data, n, default_value](size_t begin, size_t end)
+					{
+						for (size_t i = begin * n; i < end * n; i++)
+							data[i] = default_value;
+					});
+			}
+			else
+			{
+				for (size_t i = 0; i < this->rows * this->columns; i++)
+				{
+					storage[i] = default_value;
+				}
+			}
+		}
 		~matrix()
 		{
-			delete[] storage;
+			Release();
 		}
 
 
@@ -243,17 +336,21 @@ namespace Math
 			if (&M == this)
 				return *this;
 
-			// check storage size
-			if (rows * columns != M.rows * M.columns)
+			// check storage size, external storage is only reused as is
+			const bool fits = external
+				? (rows == M.rows && columns == M.columns)
+				: (rows * columns == M.rows * M.columns);
+			if (!fits)
 			{
 				// when rows and columns number doesn't match
-				delete[] storage;
-				storage = new T[M.rows * M.columns];
+				Release();
+				storage = Allocate(M.rows * M.columns, paged);
 			}
 
 			// copy values
 			rows = M.rows;
 			columns = M.columns;
+			if (!external) stride = columns;
 			default_value = M.default_value;
 
 			for (unsigned int i = 0; i < rows; i++)
@@ -273,24 +370,38 @@ namespace Math
 			if (&M == this)
 				return *this;
 
-			// transfer data
-			if (storage) delete[] storage;
-			storage = M.storage;
-			M.storage = nullptr;
+			// results of the same shape land in the external buffer
+			if (external && rows == M.rows && columns == M.columns)
+			{
+				for (unsigned int i = 0; i < rows; i++)
+				{
+					for (unsigned int j = 0; j < columns; j++)
+					{
+						Value(i, j) = M.Value(i, j);
+					}
+				}
+				default_value = M.default_value;
+				return *this;
+			}
 
+			// transfer data
+			Release();
 			rows = M.rows;
 			columns = M.columns;
 			default_value = M.default_value;
+			policy = M.policy;
+			TakeStorage(M);
 
 			return *this;
 		}
+		// index into the storage, row * LeadingDimension() + column
 		T& operator[](unsigned int index)
 		{
 			return storage[index];
 		}
 		T& operator()(const unsigned int& row, const unsigned int& column)
 		{
-			return storage[row * columns + column];
+			return storage[row * stride + column];
 		}
 
 	public:
@@ -379,24 +490,63 @@ namespace Math
 				}
 			}
 		}
-		void Transpose()
+		// false (M untouched) for external storage that isn't square: the
+		// buffer is kept, and its owner's layout can't change under it
+		bool Transpose()
 		{
-			// transpose matrix to new storage
-			T *storage_copy = new T[rows * columns];
-			for (unsigned int i = 0; i < rows; i++)
+			if (external)
 			{
-				for (unsigned int j = 0; j < columns; j++)
+				if (rows != columns)
+					return false;
+				for (size_t i = 0; i < rows; i++)
+				{
+					for (size_t j = i + 1; j < columns; j++)
+					{
+						std::swap(storage[i * stride + j], storage[j * stride + i]);
+					}
+				}
+				return true;
+			}
+
+			if (storage == inline_storage)
+			{
+				// transpose through a copy on the stack
+				T source[inline_capacity];
+				for (size_t i = 0; i < rows * columns; i++)
 				{
-					storage_copy[j * rows + i] = storage[i * columns + j];
+					source[i] = storage[i];
+				}
+				for (unsigned int i = 0; i < rows; i++)
+				{
+					for (unsigned int j = 0; j < columns; j++)
+					{
+						storage[j * rows + i] = source[i * columns + j];
+					}
 				}
 			}
-			delete[] storage;
-			storage = storage_copy;
+			else
+			{
+				// transpose matrix to new storage
+				bool copy_paged = false;
+				T *storage_copy = Allocate(rows * columns, copy_paged);
+				for (unsigned int i = 0; i < rows; i++)
+				{
+					for (unsigned int j = 0; j < columns; j++)
+					{
+						storage_copy[j * rows + i] = storage[i * stride + j];
+					}
+				}
+				Release();
+				storage = storage_copy;
+				paged = copy_paged;
+			}
 
 			// swap rows and columns
 			unsigned int temp = rows;
 			rows = columns;
 			columns = temp;
+			stride = columns;
+			return true;
 		}
 		T Trace()
 		{
@@ -407,8 +557,9 @@ namespace Math
 				{
 					sum += Value(i, i);
 				}
+				return sum;
 			}
-			return 0.0;
+			return (T)0.0;
 		}
 		void MakeIdentity()
 		{
@@ -429,17 +580,43 @@ namespace Math
 	public:
 		T& Value(unsigned int row, unsigned int column)
 		{
-			return storage[row * columns + column];
+			return storage[row * stride + column];
 		}
 		const T& Value(unsigned int row, unsigned int column) const
 		{
-			return storage[row * columns + column];
+			return storage[row * stride + column];
 		}
 		void Value(unsigned int row, unsigned int column, const T& value)
 		{
 			Value(row, column) = value;
 		}
 
+		// row-major storage, row i starts at Data() + i * LeadingDimension()
+		T* Data()
+		{
+			return storage;
+		}
+		const T* Data() const
+		{
+			return storage;
+		}
+
+		// elements between the starts of consecutive rows
+		size_t LeadingDimension() const
+		{
+			return stride;
+		}
+		// rows packed back to back, rows * columns elements
+		bool IsContiguous() const
+		{
+			return stride == columns;
+		}
+		// storage adopted from an external_buffer
+		bool IsExternal() const
+		{
+			return external;
+		}
+
 		unsigned int GetRows()
 		{
 			return rows;
@@ -469,7 +646,99 @@ namespace Math
 		{
 			default_value = new_value;
 		}
+
+		const allocation_policy& AllocationPolicy() const
+		{
+			return policy;
+		}
+		// whether the elements live in pages mapped according to the policy
+		bool IsPaged() const
+		{
+			return paged;
+		}
+
+
+	private:
+		// is_paged tells whether the storage came from AllocatePages,
+		// which only trivially copyable elements may use
+		T* Allocate(size_t count, bool& is_paged)
+		{
+			is_paged = false;
+			if (count <= inline_capacity)
+				return inline_storage;
+			if (std::is_trivially_copyable<T>::value && !policy.IsDefault())
+			{
+				void* pages = AllocatePages(count * sizeof(T), policy);
+				if (pages)
+				{
+					is_paged = true;
+					return static_cast<T*>(pages);
+				}
+			}
+			return new T[count];
+		}
+		void Release()
+		{
+			if (external)
+			{
+				if (deleter) deleter(storage);
+				deleter = nullptr;
+			}
+			else if (paged)
+				FreePages(storage, rows * columns * sizeof(T), policy);
+			else if (storage != inline_storage)
+				delete[] storage;
+			storage = nullptr;
+			paged = false;
+			external = false;
+		}
+		// takes over the elements of M (rows and columns already copied),
+		// inline elements have to be copied, heap storage is stolen
+		void TakeStorage(matrix<T>& M)
+		{
+			if (M.storage == M.inline_storage)
+			{
+				storage = inline_storage;
+				stride = columns;
+				for (size_t i = 0; i < rows * columns; i++)
+				{
+					inline_storage[i] = M.inline_storage[i];
+				}
+			}
+			else
+			{
+				storage = M.storage;
+				stride = M.stride;
+				paged = M.paged;
+				external = M.external;
+				deleter = std::move(M.deleter);
+			}
+			M.storage = nullptr;
+			M.paged = false;
+			M.external = false;
+			M.deleter = nullptr;
+			M.rows = 0;
+			M.columns = 0;
+			M.stride = 0;
+		}
 	};
+
+	// the elements of M row after row without gaps: Data() when M is
+	// contiguous, otherwise a copy in buffer, for kernels taking no
+	// leading dimension
+	template <typename T> const T* PackedData(const matrix<T>& M, std::vector<T>& buffer)
+	{
+		if (M.IsContiguous())
+			return M.Data();
+
+		const size_t rows = M.GetRows(), columns = M.GetColumns(), ld = M.LeadingDimension();
+		buffer.resize(rows * columns);
+		const T* source = M.Data();
+		for (size_t i = 0; i < rows; i++)
+			for (size_t j = 0; j < columns; j++)
+				buffer[i * columns + j] = source[i * ld + j];
+		return buffer.data();
+	}
 }
 
 #endif // !MATRIX_H
\ No newline at end of file
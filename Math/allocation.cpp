@@ -0,0 +1,168 @@
+#include "allocation.h"
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <stdio.h>	// fopen(), fscanf()
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace Math
+{
+	namespace detail
+	{
+		size_t MappedBytes(size_t bytes, const allocation_policy& policy)
+		{
+			size_t granularity = 4096u;
+#if defined(_WIN32)
+			if (policy.pages == page_size::huge)
+			{
+				const size_t large = GetLargePageMinimum();
+				if (large) granularity = large;
+			}
+#else
+			if (policy.pages != page_size::standard)
+				granularity = huge_page_bytes;
+#endif
+			return (bytes + granularity - 1) / granularity * granularity;
+		}
+	}
+
+	unsigned int NumaNodeCount()
+	{
+#if defined(_WIN32)
+		ULONG highest = 0;
+		if (GetNumaHighestNodeNumber(&highest))
+			return unsigned(highest) + 1u;
+		return 1u;
+#elif defined(__linux__)
+		// "0-3" or "0,2-5" style list of online nodes
+		FILE* file = fopen("/sys/devices/system/node/online", "r");
+		if (!file) return 1u;
+
+		unsigned int highest = 0u, first = 0u, last = 0u;
+		int c = 0;
+		while (fscanf(file, "%u", &first) == 1)
+		{
+			last = first;
+			c = fgetc(file);
+			if (c == '-' && fscanf(file, "%u", &last) == 1)
+				c = fgetc(file);
+			if (last > highest) highest = last;
+			if (c != ',') break;
+		}
+		fclose(file);
+		return highest + 1u;
+#else
+		return 1u;
+#endif
+	}
+
+	void* AllocatePages(size_t bytes, const allocation_policy& policy)
+	{
+		const size_t length = detail::MappedBytes(bytes, policy);
+		const unsigned int nodes = NumaNodeCount();
+
+#if defined(_WIN32)
+		if (policy.pages == page_size::huge && policy.placement == numa_placement::local)
+		{
+			void* memory = VirtualAlloc(nullptr, length, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+			if (memory) return memory;
+		}
+
+		if (nodes > 1u && policy.placement == numa_placement::bind)
+		{
+			void* memory = VirtualAllocExNuma(GetCurrentProcess(), nullptr, length,
+				MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, DWORD(policy.node % nodes));
+			if (memory) return memory;
+		}
+		if (nodes > 1u && policy.placement == numa_placement::interleave)
+		{
+			// reserve once, commit huge page sized chunks on alternating nodes
+			char* memory = static_cast<char*>(VirtualAlloc(nullptr, length, MEM_RESERVE, PAGE_READWRITE));
+			if (memory)
+			{
+				for (size_t offset = 0, chunk = 0; offset < length; offset += huge_page_bytes, chunk++)
+				{
+					const size_t size = (length - offset < huge_page_bytes) ? length - offset : huge_page_bytes;
+					if (!VirtualAllocExNuma(GetCurrentProcess(), memory + offset, size,
+						MEM_COMMIT, PAGE_READWRITE, DWORD(chunk % nodes)))
+					{
+						VirtualAlloc(memory + offset, size, MEM_COMMIT, PAGE_READWRITE);
+					}
+				}
+				return memory;
+			}
+		}
+		return VirtualAlloc(nullptr, length, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+
+#elif defined(__linux__)
+		void* memory = MAP_FAILED;
+#ifdef MAP_HUGETLB
+		if (policy.pages == page_size::huge)
+			memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+		if (memory == MAP_FAILED)
+		{
+			memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (memory == MAP_FAILED)
+				return nullptr;
+#ifdef MADV_HUGEPAGE
+			if (policy.pages != page_size::standard)
+				madvise(memory, length, MADV_HUGEPAGE);
+#endif
+		}
+
+#ifdef SYS_mbind
+		// raw syscall, no libnuma needed; failures leave the default policy
+		if (nodes > 1u && policy.placement != numa_placement::local)
+		{
+			const int mpol_bind = 2, mpol_interleave = 3;
+			unsigned long mask[16] = { 0u };
+			const unsigned int bits = unsigned(sizeof(mask) * 8u);
+			if (policy.placement == numa_placement::bind)
+			{
+				const unsigned int node = policy.node % nodes;
+				if (node < bits) mask[node / (sizeof(unsigned long) * 8u)] |= 1ul << (node % (sizeof(unsigned long) * 8u));
+			}
+			else
+			{
+				for (unsigned int node = 0; node < nodes && node < bits; node++)
+					mask[node / (sizeof(unsigned long) * 8u)] |= 1ul << (node % (sizeof(unsigned long) * 8u));
+			}
+			syscall(SYS_mbind, memory, length,
+				policy.placement == numa_placement::bind ? mpol_bind : mpol_interleave,
+				mask, (unsigned long)bits + 1ul, 0u);
+		}
+#endif
+		return memory;
+
+#else
+		(void)length;
+		(void)nodes;
+		return nullptr;
+#endif
+	}
+	void FreePages(void* memory, size_t bytes, const allocation_policy& policy)
+	{
+		if (!memory) return;
+#if defined(_WIN32)
+		(void)bytes;
+		(void)policy;
+		VirtualFree(memory, 0, MEM_RELEASE);
+#elif defined(__linux__)
+		munmap(memory, detail::MappedBytes(bytes, policy));
+#else
+		(void)bytes;
+		(void)policy;
+#endif
+	}
+}
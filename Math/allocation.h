@@ -0,0 +1,69 @@
+#ifndef ALLOCATION_H
+#define ALLOCATION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace Math
+{
+	enum class page_size
+	{
+		standard,			// regular pages
+		transparent_huge,	// regular mapping advised for transparent huge pages (Linux)
+		huge				// explicit huge/large pages, transparent ones when unavailable
+	};
+	enum class numa_placement
+	{
+		local,		// the kernel's default, first touch on Linux and Windows
+		bind,		// all pages on one node
+		interleave	// pages spread round robin over all nodes
+	};
+
+	// How matrix<T> obtains storage for large element counts. Anything but
+	// the default maps pages directly from the OS instead of new T[].
+	// The OS calls live in allocation.cpp, so the platform headers stay
+	// out of everything that includes matrix<T>.
+	// Requests the machine can't satisfy (no NUMA, no huge pages, missing
+	// privileges) silently fall back to regular pages, and if mapping
+	// fails entirely to new T[].
+	//
+	// first_touch leaves the pages untouched until the matrix constructor
+	// initializes its rows in parallel on the shared pool, so with local
+	// placement each row block lands on the node of the worker that wrote
+	// it. Later passes get the best locality when they split rows with
+	// the same grain (FirstTouchRows); the pool doesn't pin blocks to
+	// threads, so interleave is the robust choice when that matters.
+	struct allocation_policy
+	{
+		page_size pages = page_size::standard;
+		numa_placement placement = numa_placement::local;
+		unsigned int node = 0u;	// for bind
+		bool first_touch = false;
+
+		bool IsDefault() const
+		{
+			return pages == page_size::standard && placement == numa_placement::local && !first_touch;
+		}
+	};
+
+	constexpr size_t huge_page_bytes = size_t(2u) << 20;
+
+	// rows per first touch block, a few pages per block
+	inline size_t FirstTouchRows(size_t row_bytes)
+	{
+		const size_t block_bytes = size_t(256u) << 10;
+		return (row_bytes && row_bytes < block_bytes) ? block_bytes / row_bytes : 1u;
+	}
+
+
+	// number of NUMA nodes, 1 when unknown
+	unsigned int NumaNodeCount();
+
+	// Maps at least bytes of zeroed memory according to policy, nullptr
+	// when the platform offers no page mapping or it failed. Free with
+	// FreePages and the same bytes and policy.
+	void* AllocatePages(size_t bytes, const allocation_policy& policy);
+	void FreePages(void* memory, size_t bytes, const allocation_policy& policy);
+}
+
+#endif // !ALLOCATION_H
@@ -1,7 +1,7 @@
 #ifndef ANGLE_H
 #define ANGLE_H
 
-#include "constants.h"
+#include "Constants.h"
 #include <cmath>
 
 namespace Math
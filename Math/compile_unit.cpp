@@ -1,5 +1,31 @@
 #include "angle.h"
-#include "constants.h"
-#include "matrix.h"
+#include "Constants.h"
+#include "Matrix.h"
 #include "vec2.h"
-#include "vec3.h"
\ No newline at end of file
+#include "vec3.h"
+#include "parallel.h"
+#include "reduction.h"
+#include "half.h"
+#include "matrix_narrow.h"
+#include "quantized.h"
+#include "gemv.h"
+#include "gemm.h"
+#include "matrix_chain.h"
+#include "strassen.h"
+#include "matrix_batch.h"
+#include "lu.h"
+#include "matrix_async.h"
+#include "allocation.h"
+#include "elementwise.h"
+#include "matrix_reduction.h"
+#include "convolution.h"
+#include "random.h"
+#include "decomposition3.h"
+#include "spatial_sort.h"
+#include "vec3_packing.h"
+#include "culling.h"
+#include "interpolation.h"
+#include "matrix_accumulator.h"
+#include "mesh.h"
+#include "coordinates.h"
+#include "shared_matrix.h"
\ No newline at end of file
@@ -0,0 +1,709 @@
+#ifndef CONVOLUTION_H
+#define CONVOLUTION_H
+
+#include "gemm.h"
+#include "Matrix.h"
+#include "parallel.h"
+
+#include <cmath>	// std::cos(), std::sin(), std::fabs()
+#include <complex>
+#include <limits>
+#include <stddef.h>
+#include <vector>
+
+namespace Math
+{
+	// 2D correlation and convolution of matrix<T> images (T float or
+	// double). Convolve flips the kernel, Correlate doesn't, both compute
+	//     out(y, x) = sum k(u, v) in(y * stride_rows + u, x * stride_columns + v)
+	// over the input with pad_rows/pad_columns zeros around it.
+	//
+	// Strategies:
+	//  direct    - output rows in parallel, column tiles of the output row
+	//              accumulate one kernel tap at a time over contiguous input
+	//  separable - rank-1 kernels as a row pass and a column pass,
+	//              kh + kw instead of kh * kw multiply-adds per output
+	//  im2col    - input patches as columns of a matrix and one Gemm for a
+	//              whole bank of kernels, built in strips of output rows
+	//  fft       - products of 2D spectra, cost independent of the kernel
+	//              size, only for stride 1
+	// automatic takes separable for rank-1 kernels of at least 3 x 3, fft
+	// for stride 1 and at least convolution_fft_area kernel elements and
+	// direct otherwise; banks of at least convolution_bank_size kernels
+	// go through im2col.
+	//
+	// Batches of channels reuse a convolution_workspace, so once it has
+	// grown to the largest shape no call allocates (outputs of the right
+	// size aren't reallocated either).
+
+	enum class convolution_strategy
+	{
+		automatic,
+		direct,
+		separable,
+		im2col,
+		fft
+	};
+
+	struct convolution_options
+	{
+		unsigned int pad_rows = 0u;		// zero rows above and below
+		unsigned int pad_columns = 0u;	// zero columns left and right
+		unsigned int stride_rows = 1u;
+		unsigned int stride_columns = 1u;
+		convolution_strategy strategy = convolution_strategy::automatic;
+	};
+
+	constexpr size_t convolution_fft_area = 144u;
+	constexpr size_t convolution_bank_size = 4u;
+
+	// scratch reused between calls, contents are meaningless to callers
+	template <typename T> struct convolution_workspace
+	{
+		std::vector<T> padded;
+		std::vector<T> kernels;
+		std::vector<T> row_factor, column_factor;
+		std::vector<T> pass;
+		std::vector<T> columns;
+		std::vector<std::complex<T>> spectrum, kernel_spectrum;
+		std::vector<std::complex<T>> row_twiddles, column_twiddles;
+		std::vector<T*> outputs;
+		std::vector<size_t> output_lds;
+	};
+
+	// output size along one dimension, 0 when the kernel doesn't fit
+	inline unsigned int ConvolutionOutputSize(unsigned int input, unsigned int kernel, unsigned int pad, unsigned int stride)
+	{
+		if (stride == 0u || input + 2u * pad < kernel) return 0u;
+		return (input + 2u * pad - kernel) / stride + 1u;
+	}
+	// padding that keeps the input size for stride 1 and odd kernels
+	template <typename T> convolution_options SamePadding(const matrix<T>& kernel)
+	{
+		convolution_options options;
+		options.pad_rows = (kernel.GetRows() - 1u) / 2u;
+		options.pad_columns = (kernel.GetColumns() - 1u) / 2u;
+		return options;
+	}
+
+	namespace detail
+	{
+		constexpr size_t convolution_tile = 256u;
+		constexpr size_t convolution_grain = 1u << 16;			// multiply-adds per task
+		constexpr size_t convolution_im2col_elements = 1u << 22;	// per strip
+		constexpr size_t fft_column_block = 16u;
+
+		struct convolution_shape
+		{
+			size_t height, width;	// padded input
+			size_t ld;				// of the padded input
+			size_t kh, kw;
+			size_t out_h, out_w;
+			size_t out_ld;			// of the output rows
+			size_t sr, sc;
+		};
+
+		inline size_t RowsPerTask(size_t work_per_row)
+		{
+			return (work_per_row && work_per_row < convolution_grain) ? convolution_grain / work_per_row : 1u;
+		}
+		inline size_t NextPowerOfTwo(size_t n)
+		{
+			size_t p = 1u;
+			while (p < n) p <<= 1;
+			return p;
+		}
+
+		// elements of a and b share memory (an output written over its input)
+		template <typename T> bool Overlaps(const matrix<T>& a, const matrix<T>& b)
+		{
+			const T* a_end = a.Data() + (a.GetRows() - 1u) * a.LeadingDimension() + a.GetColumns();
+			const T* b_end = b.Data() + (b.GetRows() - 1u) * b.LeadingDimension() + b.GetColumns();
+			return a.Data() < b_end && b.Data() < a_end;
+		}
+
+		// the input itself when there's no padding and it isn't about to
+		// be overwritten (copy), otherwise a zero bordered copy in buffer
+		template <typename T> const T* PaddedInput(const matrix<T>& input, const convolution_options& options,
+			std::vector<T>& buffer, convolution_shape& shape, bool copy)
+		{
+			const size_t h = input.GetRows(), w = input.GetColumns();
+			const size_t pr = options.pad_rows, pc = options.pad_columns;
+			shape.height = h + 2u * pr;
+			shape.width = w + 2u * pc;
+			if (pr == 0u && pc == 0u && !copy)
+			{
+				shape.ld = input.LeadingDimension();
+				return input.Data();
+			}
+
+			shape.ld = shape.width;
+			buffer.assign(shape.height * shape.width, T(0));
+			const T* source = input.Data();
+			const size_t source_ld = input.LeadingDimension();
+			T* destination = buffer.data() + pr * shape.width + pc;
+			for (size_t i = 0; i < h; i++)
+				for (size_t j = 0; j < w; j++)
+					destination[i * shape.width + j] = source[i * source_ld + j];
+			return buffer.data();
+		}
+
+		// rank-1 test: k = column * row^T within a few ulps of the largest
+		// element
+		template <typename T> bool SeparateKernel(const T* k, size_t kh, size_t kw,
+			std::vector<T>& column, std::vector<T>& row)
+		{
+			size_t p = 0, q = 0;
+			T largest = T(0);
+			for (size_t u = 0; u < kh; u++)
+				for (size_t v = 0; v < kw; v++)
+				{
+					if (std::fabs(k[u * kw + v]) > largest)
+					{
+						largest = std::fabs(k[u * kw + v]);
+						p = u;
+						q = v;
+					}
+				}
+			if (largest == T(0))
+				return false;
+
+			column.resize(kh);
+			row.resize(kw);
+			for (size_t u = 0; u < kh; u++)
+				column[u] = k[u * kw + q];
+			for (size_t v = 0; v < kw; v++)
+				row[v] = k[p * kw + v] / k[p * kw + q];
+
+			const T tolerance = T(8) * T(kh + kw) * std::numeric_limits<T>::epsilon() * largest;
+			for (size_t u = 0; u < kh; u++)
+				for (size_t v = 0; v < kw; v++)
+				{
+					if (std::fabs(k[u * kw + v] - column[u] * row[v]) > tolerance)
+						return false;
+				}
+			return true;
+		}
+
+		template <typename T> void CorrelateDirect(const T* in, const T* k, const convolution_shape& s, T* out)
+		{
+			ParallelFor(s.out_h, RowsPerTask(s.out_w * s.kh * s.kw), [in, k, s, out](size_t begin, size_t end)
+				{
+					for (size_t oy = begin; oy < end; oy++)
+					{
+						T* o_row = out + oy * s.out_ld;
+						for (size_t x0 = 0; x0 < s.out_w; x0 += convolution_tile)
+						{
+							const size_t xn = (s.out_w - x0 < convolution_tile) ? s.out_w - x0 : convolution_tile;
+							T* o = o_row + x0;
+							for (size_t x = 0; x < xn; x++)
+								o[x] = T(0);
+
+							for (size_t u = 0; u < s.kh; u++)
+							{
+								const T* i_row = in + (oy * s.sr + u) * s.ld + x0 * s.sc;
+								for (size_t v = 0; v < s.kw; v++)
+								{
+									const T kv = k[u * s.kw + v];
+									const T* source = i_row + v;
+									if (s.sc == 1u)
+									{
+										for (size_t x = 0; x < xn; x++)
+											o[x] += kv * source[x];
+									}
+									else
+									{
+										for (size_t x = 0; x < xn; x++)
+											o[x] += kv * source[x * s.sc];
+									}
+								}
+							}
+						}
+					}
+				});
+		}
+
+		template <typename T> void CorrelateSeparable(const T* in, const T* column, const T* row,
+			const convolution_shape& s, std::vector<T>& pass, T* out)
+		{
+			// row pass over every input row the column pass will read
+			const size_t used_rows = (s.out_h - 1u) * s.sr + s.kh;
+			pass.resize(used_rows * s.out_w);
+			T* p = pass.data();
+
+			ParallelFor(used_rows, RowsPerTask(s.out_w * s.kw), [in, row, s, p](size_t begin, size_t end)
+				{
+					for (size_t y = begin; y < end; y++)
+					{
+						T* o = p + y * s.out_w;
+						const T* i_row = in + y * s.ld;
+						for (size_t x = 0; x < s.out_w; x++)
+							o[x] = T(0);
+						for (size_t v = 0; v < s.kw; v++)
+						{
+							const T kv = row[v];
+							const T* source = i_row + v;
+							if (s.sc == 1u)
+							{
+								for (size_t x = 0; x < s.out_w; x++)
+									o[x] += kv * source[x];
+							}
+							else
+							{
+								for (size_t x = 0; x < s.out_w; x++)
+									o[x] += kv * source[x * s.sc];
+							}
+						}
+					}
+				});
+			ParallelFor(s.out_h, RowsPerTask(s.out_w * s.kh), [column, s, p, out](size_t begin, size_t end)
+				{
+					for (size_t oy = begin; oy < end; oy++)
+					{
+						T* o = out + oy * s.out_ld;
+						for (size_t x = 0; x < s.out_w; x++)
+							o[x] = T(0);
+						for (size_t u = 0; u < s.kh; u++)
+						{
+							const T ku = column[u];
+							const T* source = p + (oy * s.sr + u) * s.out_w;
+							for (size_t x = 0; x < s.out_w; x++)
+								o[x] += ku * source[x];
+						}
+					}
+				});
+		}
+
+		// kernels are count stacked kh * kw rows, outs count outputs with
+		// rows out_lds[i] apart
+		template <typename T> void CorrelateIm2col(const T* in, const T* kernels, size_t count,
+			const convolution_shape& s, std::vector<T>& columns, std::vector<T>& pass,
+			T* const* outs, const size_t* out_lds)
+		{
+			const size_t depth = s.kh * s.kw;
+			const size_t strip_rows = (depth * s.out_w < convolution_im2col_elements) ?
+				convolution_im2col_elements / (depth * s.out_w) : 1u;
+
+			for (size_t y0 = 0; y0 < s.out_h; y0 += strip_rows)
+			{
+				const size_t rows = (s.out_h - y0 < strip_rows) ? s.out_h - y0 : strip_rows;
+				const size_t n = rows * s.out_w;
+				columns.resize(depth * n);
+				pass.resize(count * n);
+				T* c = columns.data();
+				T* r = pass.data();
+
+				// one row per kernel tap holds that tap's input for every output
+				ParallelFor(depth, RowsPerTask(n), [in, s, y0, rows, n, c](size_t begin, size_t end)
+					{
+						for (size_t t = begin; t < end; t++)
+						{
+							const size_t u = t / s.kw, v = t % s.kw;
+							T* destination = c + t * n;
+							for (size_t oy = 0; oy < rows; oy++)
+							{
+								const T* source = in + ((y0 + oy) * s.sr + u) * s.ld + v;
+								for (size_t x = 0; x < s.out_w; x++)
+									destination[oy * s.out_w + x] = source[x * s.sc];
+							}
+						}
+					});
+
+				// a bank has few kernels, so split the product along columns
+				const size_t block = gemm_block_columns;
+				ParallelFor((n + block - 1) / block, RowsPerTask(block * depth * count),
+					[kernels, count, depth, n, c, r, block](size_t begin, size_t end)
+					{
+						for (size_t b = begin; b < end; b++)
+						{
+							const size_t j0 = b * block;
+							const size_t nc = (n - j0 < block) ? n - j0 : block;
+							Gemm(count, nc, depth, kernels, depth, c + j0, n, r + j0, n);
+						}
+					});
+
+				for (size_t i = 0; i < count; i++)
+				{
+					for (size_t y = 0; y < rows; y++)
+					{
+						const T* source = r + i * n + y * s.out_w;
+						T* destination = outs[i] + (y0 + y) * out_lds[i];
+						for (size_t x = 0; x < s.out_w; x++)
+							destination[x] = source[x];
+					}
+				}
+			}
+		}
+
+		// fft
+
+		// n / 2 factors for a power of two n, the size identifies n
+		template <typename T> void Twiddles(std::vector<std::complex<T>>& twiddles, size_t n)
+		{
+			if (twiddles.size() == n / 2u)
+				return;
+			twiddles.resize(n / 2u);
+			for (size_t k = 0; k < n / 2u; k++)
+			{
+				const double angle = -6.283185307179586 * double(k) / double(n);
+				twiddles[k] = std::complex<T>(T(std::cos(angle)), T(std::sin(angle)));
+			}
+		}
+
+		// In place radix-2 FFT of n points, point i being the width
+		// consecutive values at data + i * stride, so a block of columns
+		// is transformed with contiguous inner loops. Complex products are
+		// spelled out to avoid the NaN handling of std::complex.
+		template <typename T> void FFT(std::complex<T>* data, size_t n, size_t stride, size_t width,
+			const std::complex<T>* twiddles, bool inverse)
+		{
+			for (size_t i = 1, j = 0; i < n; i++)
+			{
+				size_t bit = n >> 1;
+				for (; j & bit; bit >>= 1)
+					j ^= bit;
+				j ^= bit;
+				if (i < j)
+				{
+					std::complex<T>* a = data + i * stride;
+					std::complex<T>* b = data + j * stride;
+					for (size_t c = 0; c < width; c++)
+					{
+						const std::complex<T> temp = a[c];
+						a[c] = b[c];
+						b[c] = temp;
+					}
+				}
+			}
+
+			for (size_t length = 2; length <= n; length <<= 1)
+			{
+				const size_t half = length / 2u, step = n / length;
+				for (size_t i = 0; i < n; i += length)
+				{
+					for (size_t k = 0; k < half; k++)
+					{
+						const T wr = twiddles[k * step].real();
+						const T wi = inverse ? -twiddles[k * step].imag() : twiddles[k * step].imag();
+						std::complex<T>* a = data + (i + k) * stride;
+						std::complex<T>* b = data + (i + k + half) * stride;
+						for (size_t c = 0; c < width; c++)
+						{
+							const T br = b[c].real(), bi = b[c].imag();
+							const T tr = wr * br - wi * bi;
+							const T ti = wr * bi + wi * br;
+							const T ar = a[c].real(), ai = a[c].imag();
+							b[c] = std::complex<T>(ar - tr, ai - ti);
+							a[c] = std::complex<T>(ar + tr, ai + ti);
+						}
+					}
+				}
+			}
+		}
+
+		// spectrum of the rows x columns real block at source (leading
+		// dimension ld) zero extended to n x m
+		template <typename T> void Spectrum(const T* source, size_t rows, size_t columns, size_t ld,
+			size_t n, size_t m, std::vector<std::complex<T>>& spectrum,
+			const std::vector<std::complex<T>>& row_twiddles, const std::vector<std::complex<T>>& column_twiddles)
+		{
+			spectrum.assign(n * m, std::complex<T>());
+			std::complex<T>* s = spectrum.data();
+			const std::complex<T>* rt = row_twiddles.data();
+			const std::complex<T>* ct = column_twiddles.data();
+
+			// rows past the block are zero and stay zero
+			ParallelFor(rows, RowsPerTask(m * 8u), [source, columns, ld, m, s, rt](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; i++)
+					{
+						for (size_t j = 0; j < columns; j++)
+							s[i * m + j] = std::complex<T>(source[i * ld + j]);
+						FFT(s + i * m, m, size_t(1), size_t(1), rt, false);
+					}
+				});
+			const size_t blocks = (m + fft_column_block - 1) / fft_column_block;
+			ParallelFor(blocks, RowsPerTask(n * fft_column_block * 8u), [n, m, s, ct](size_t begin, size_t end)
+				{
+					for (size_t b = begin; b < end; b++)
+					{
+						const size_t c0 = b * fft_column_block;
+						const size_t width = (m - c0 < fft_column_block) ? m - c0 : fft_column_block;
+						FFT(s + c0, n, m, width, ct, false);
+					}
+				});
+		}
+
+		template <typename T> void CorrelateFFT(const T* in, const convolution_shape& s,
+			convolution_workspace<T>& workspace, T* out)
+		{
+			const size_t n = NextPowerOfTwo(s.height), m = NextPowerOfTwo(s.width);
+			Spectrum(in, s.height, s.width, s.ld, n, m, workspace.spectrum, workspace.row_twiddles, workspace.column_twiddles);
+
+			// correlation with a real kernel multiplies by its conjugate spectrum
+			std::complex<T>* a = workspace.spectrum.data();
+			const std::complex<T>* b = workspace.kernel_spectrum.data();
+			const std::complex<T>* rt = workspace.row_twiddles.data();
+			const std::complex<T>* ct = workspace.column_twiddles.data();
+			ParallelFor(n, RowsPerTask(m * 4u), [a, b, m](size_t begin, size_t end)
+				{
+					for (size_t i = begin * m; i < end * m; i++)
+					{
+						const T ar = a[i].real(), ai = a[i].imag();
+						const T br = b[i].real(), bi = b[i].imag();
+						a[i] = std::complex<T>(ar * br + ai * bi, ai * br - ar * bi);
+					}
+				});
+
+			const size_t blocks = (m + fft_column_block - 1) / fft_column_block;
+			ParallelFor(blocks, RowsPerTask(n * fft_column_block * 8u), [a, n, m, ct](size_t begin, size_t end)
+				{
+					for (size_t block = begin; block < end; block++)
+					{
+						const size_t c0 = block * fft_column_block;
+						const size_t width = (m - c0 < fft_column_block) ? m - c0 : fft_column_block;
+						FFT(a + c0, n, m, width, ct, true);
+					}
+				});
+			// only the rows holding outputs are transformed back
+			const T scale = T(1) / T(n * m);
+			ParallelFor(s.out_h, RowsPerTask(m * 8u), [a, s, m, rt, scale, out](size_t begin, size_t end)
+				{
+					for (size_t oy = begin; oy < end; oy++)
+					{
+						std::complex<T>* row = a + oy * m;
+						FFT(row, m, size_t(1), size_t(1), rt, true);
+						for (size_t x = 0; x < s.out_w; x++)
+							out[oy * s.out_ld + x] = row[x].real() * scale;
+					}
+				});
+		}
+
+		template <typename T> convolution_strategy ChooseStrategy(const convolution_options& options,
+			size_t kh, size_t kw, bool separable)
+		{
+			if (options.strategy != convolution_strategy::automatic)
+				return options.strategy;
+			if (separable && kh >= 3u && kw >= 3u)
+				return convolution_strategy::separable;
+			if (options.stride_rows == 1u && options.stride_columns == 1u && kh * kw >= convolution_fft_area)
+				return convolution_strategy::fft;
+			return convolution_strategy::direct;
+		}
+
+		template <typename T> bool ValidShape(const matrix<T>& input, const matrix<T>& kernel, const convolution_options& options)
+		{
+			return ConvolutionOutputSize(input.GetRows(), kernel.GetRows(), options.pad_rows, options.stride_rows) != 0u &&
+				ConvolutionOutputSize(input.GetColumns(), kernel.GetColumns(), options.pad_columns, options.stride_columns) != 0u;
+		}
+		template <typename T> void FitOutput(matrix<T>& output, unsigned int rows, unsigned int columns)
+		{
+			if (output.GetRows() != rows || output.GetColumns() != columns)
+				output = matrix<T>(rows, columns);
+		}
+
+		// kernel_count is 1 (shared by all channels) or channels; the
+		// kernels are flipped first for a convolution
+		template <typename T> bool CorrelateChannels(const matrix<T>* inputs, const matrix<T>* kernels, size_t kernel_count,
+			matrix<T>* outputs, size_t channels, const convolution_options& options,
+			convolution_workspace<T>& workspace, bool flip)
+		{
+			if (channels == 0u) return true;
+			if (kernel_count != 1u && kernel_count != channels) return false;
+
+			const size_t kh = kernels[0].GetRows(), kw = kernels[0].GetColumns();
+			for (size_t c = 0; c < kernel_count; c++)
+			{
+				if (kernels[c].GetRows() != kh || kernels[c].GetColumns() != kw) return false;
+			}
+			for (size_t c = 0; c < channels; c++)
+			{
+				if (!ValidShape(inputs[c], kernels[0], options)) return false;
+			}
+
+			// kernels in correlation order
+			const size_t area = kh * kw;
+			workspace.kernels.resize(kernel_count * area);
+			for (size_t c = 0; c < kernel_count; c++)
+			{
+				const T* source = PackedData(kernels[c], workspace.padded);
+				T* destination = workspace.kernels.data() + c * area;
+				for (size_t i = 0; i < area; i++)
+					destination[i] = flip ? source[area - 1u - i] : source[i];
+			}
+
+			bool separable = kernel_count == 1u &&
+				SeparateKernel(workspace.kernels.data(), kh, kw, workspace.column_factor, workspace.row_factor);
+			const convolution_strategy strategy = ChooseStrategy<T>(options, kh, kw, separable);
+			size_t spectrum_n = 0u, spectrum_m = 0u;
+
+			for (size_t c = 0; c < channels; c++)
+			{
+				const T* k = workspace.kernels.data() + (kernel_count == 1u ? 0u : c * area);
+				if (kernel_count != 1u && strategy == convolution_strategy::separable)
+					separable = SeparateKernel(k, kh, kw, workspace.column_factor, workspace.row_factor);
+
+				convolution_shape s;
+				const T* in = PaddedInput(inputs[c], options, workspace.padded, s, Overlaps(inputs[c], outputs[c]));
+				s.kh = kh;
+				s.kw = kw;
+				s.sr = options.stride_rows;
+				s.sc = options.stride_columns;
+				s.out_h = ConvolutionOutputSize(inputs[c].GetRows(), unsigned(kh), options.pad_rows, options.stride_rows);
+				s.out_w = ConvolutionOutputSize(inputs[c].GetColumns(), unsigned(kw), options.pad_columns, options.stride_columns);
+				FitOutput(outputs[c], unsigned(s.out_h), unsigned(s.out_w));
+				s.out_ld = outputs[c].LeadingDimension();
+				T* out = outputs[c].Data();
+
+				switch (strategy)
+				{
+					case convolution_strategy::separable:
+						if (separable)
+						{
+							CorrelateSeparable(in, workspace.column_factor.data(), workspace.row_factor.data(), s, workspace.pass, out);
+							break;
+						}
+						CorrelateDirect(in, k, s, out);
+						break;
+					case convolution_strategy::im2col:
+					{
+						T* outs[1] = { out };
+						CorrelateIm2col(in, k, size_t(1), s, workspace.columns, workspace.pass, outs, &s.out_ld);
+						break;
+					}
+					case convolution_strategy::fft:
+						if (s.sr == 1u && s.sc == 1u)
+						{
+							// the kernel spectrum is kept while the padded size repeats
+							const size_t n = NextPowerOfTwo(s.height), m = NextPowerOfTwo(s.width);
+							if (n != spectrum_n || m != spectrum_m || kernel_count != 1u)
+							{
+								Twiddles(workspace.row_twiddles, m);
+								Twiddles(workspace.column_twiddles, n);
+								Spectrum(k, kh, kw, kw, n, m, workspace.kernel_spectrum, workspace.row_twiddles, workspace.column_twiddles);
+								spectrum_n = n;
+								spectrum_m = m;
+							}
+							CorrelateFFT(in, s, workspace, out);
+							break;
+						}
+						CorrelateDirect(in, k, s, out);
+						break;
+					default:
+						CorrelateDirect(in, k, s, out);
+						break;
+				}
+			}
+			return true;
+		}
+	}
+
+
+	// single image; output is resized to the output dimensions, false
+	// when the kernel doesn't fit or a stride is 0. output may be input,
+	// the input is then read from a copy in the workspace.
+	template <typename T> bool Correlate(const matrix<T>& input, const matrix<T>& kernel, matrix<T>& output,
+		const convolution_options& options, convolution_workspace<T>& workspace)
+	{
+		return detail::CorrelateChannels(&input, &kernel, size_t(1), &output, size_t(1), options, workspace, false);
+	}
+	template <typename T> bool Correlate(const matrix<T>& input, const matrix<T>& kernel, matrix<T>& output,
+		const convolution_options& options = convolution_options())
+	{
+		convolution_workspace<T> workspace;
+		return Correlate(input, kernel, output, options, workspace);
+	}
+	template <typename T> bool Convolve(const matrix<T>& input, const matrix<T>& kernel, matrix<T>& output,
+		const convolution_options& options, convolution_workspace<T>& workspace)
+	{
+		return detail::CorrelateChannels(&input, &kernel, size_t(1), &output, size_t(1), options, workspace, true);
+	}
+	template <typename T> bool Convolve(const matrix<T>& input, const matrix<T>& kernel, matrix<T>& output,
+		const convolution_options& options = convolution_options())
+	{
+		convolution_workspace<T> workspace;
+		return Convolve(input, kernel, output, options, workspace);
+	}
+
+	// channels inputs into channels outputs, with one kernel for every
+	// channel (kernel_count 1) or one kernel per channel; outputs[c] may
+	// be inputs[c], but not the input of another channel
+	template <typename T> bool CorrelateChannels(const matrix<T>* inputs, const matrix<T>* kernels, size_t kernel_count,
+		matrix<T>* outputs, size_t channels, const convolution_options& options, convolution_workspace<T>& workspace)
+	{
+		return detail::CorrelateChannels(inputs, kernels, kernel_count, outputs, channels, options, workspace, false);
+	}
+	template <typename T> bool ConvolveChannels(const matrix<T>* inputs, const matrix<T>* kernels, size_t kernel_count,
+		matrix<T>* outputs, size_t channels, const convolution_options& options, convolution_workspace<T>& workspace)
+	{
+		return detail::CorrelateChannels(inputs, kernels, kernel_count, outputs, channels, options, workspace, true);
+	}
+
+	// a bank of equally sized kernels over one input, outputs[i] for
+	// kernels[i]; with automatic strategy banks of convolution_bank_size
+	// or more share one im2col matrix and one Gemm. An output may be
+	// input, which is then read from a copy in the workspace.
+	template <typename T> bool CorrelateBank(const matrix<T>& input, const matrix<T>* kernels, size_t count,
+		matrix<T>* outputs, const convolution_options& options, convolution_workspace<T>& workspace)
+	{
+		bool overwritten = false;
+		for (size_t i = 0; i < count; i++)
+			overwritten = overwritten || detail::Overlaps(input, outputs[i]);
+
+		const bool bank = options.strategy == convolution_strategy::im2col ||
+			(options.strategy == convolution_strategy::automatic && count >= convolution_bank_size);
+		if (!bank)
+		{
+			// later kernels still read the input an earlier output replaced
+			if (overwritten)
+			{
+				const matrix<T> source(input);
+				return CorrelateBank(source, kernels, count, outputs, options, workspace);
+			}
+			for (size_t i = 0; i < count; i++)
+			{
+				if (!Correlate(input, kernels[i], outputs[i], options, workspace)) return false;
+			}
+			return true;
+		}
+
+		if (count == 0u) return true;
+		if (!detail::ValidShape(input, kernels[0], options)) return false;
+		const unsigned int out_h = ConvolutionOutputSize(input.GetRows(), kernels[0].GetRows(), options.pad_rows, options.stride_rows);
+		const unsigned int out_w = ConvolutionOutputSize(input.GetColumns(), kernels[0].GetColumns(), options.pad_columns, options.stride_columns);
+
+		const size_t kh = kernels[0].GetRows(), kw = kernels[0].GetColumns(), area = kh * kw;
+		workspace.kernels.resize(count * area);
+		for (size_t i = 0; i < count; i++)
+		{
+			if (kernels[i].GetRows() != kh || kernels[i].GetColumns() != kw) return false;
+			const T* source = PackedData(kernels[i], workspace.padded);
+			for (size_t j = 0; j < area; j++)
+				workspace.kernels[i * area + j] = source[j];
+		}
+
+		detail::convolution_shape s;
+		const T* in = detail::PaddedInput(input, options, workspace.padded, s, overwritten);
+		s.kh = kh;
+		s.kw = kw;
+		s.sr = options.stride_rows;
+		s.sc = options.stride_columns;
+		s.out_h = out_h;
+		s.out_w = out_w;
+		s.out_ld = out_w;
+
+		workspace.outputs.resize(count);
+		workspace.output_lds.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			detail::FitOutput(outputs[i], out_h, out_w);
+			workspace.outputs[i] = outputs[i].Data();
+			workspace.output_lds[i] = outputs[i].LeadingDimension();
+		}
+		detail::CorrelateIm2col(in, workspace.kernels.data(), count, s, workspace.columns, workspace.pass,
+			workspace.outputs.data(), workspace.output_lds.data());
+		return true;
+	}
+}
+
+#endif // !CONVOLUTION_H
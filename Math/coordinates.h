@@ -0,0 +1,420 @@
+#ifndef COORDINATES_H
+#define COORDINATES_H
+
+#include "angle.h"
+#include "Constants.h"
+#include "parallel.h"
+#include "vec2.h"
+#include "vec3.h"
+
+#include <math.h>	// atan2(), sin(), cos(), sqrt(), floor(), fabs()
+#include <stddef.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace Math
+{
+	// Bulk conversion between Cartesian and polar / spherical coordinates
+	// with the angles typed by unit. Spherical coordinates are radius,
+	// azimuth atan2(y, x) in (-pi, pi] and elevation above the xy plane
+	// in [-pi/2, pi/2]; polar ones radius and atan2(y, x).
+	//
+	// Elements are transposed per block into SoA form and atan2 and
+	// sin / cos evaluated branch free with polynomials selected by
+	// trig_accuracy, 8 per instruction in float with AVX2. Maximum
+	// absolute error in radians:
+	//	fast		1.2e-5 (atan2), 3.7e-5 (sin, cos)
+	//	precise		4e-8 (atan2), 2e-9 (sin, cos), below float rounding
+	//	exact		the C library's functions, the choice for double
+	// The angle unit only scales the results, degrees and revolutions
+	// cost one multiply. Nothing is allocated.
+
+	enum class trig_accuracy { fast, precise, exact };
+
+	namespace detail
+	{
+		constexpr size_t coordinates_block = 64u;
+		constexpr size_t coordinates_grain = 16384u;
+
+		template <angle_unit U, typename T> T RadiansPerUnit()
+		{
+			return
+				U == angle_unit::deg ? T(constants<T>::pi) / T(180) :
+				U == angle_unit::rev ? T(constants<T>::tau) : T(1);
+		}
+
+		// pi / 2 split so that k * hi is exact for the quadrant counts
+		// of any reasonable angle (Cody-Waite reduction)
+		template <typename T> struct half_pi_split;
+		template <> struct half_pi_split<float>
+		{
+			static constexpr float hi = 1.5703125f;
+			static constexpr float lo = 4.83826794897e-4f;
+		};
+		template <> struct half_pi_split<double>
+		{
+			static constexpr double hi = 1.57079632673412561417e+00;
+			static constexpr double lo = 6.07710050650619224932e-11;
+		};
+
+		// arithmetic shared by scalars and vector registers, so the
+		// polynomials are written once
+		template <typename V> V Splat(double c)
+		{
+			return V(c);
+		}
+		template <typename V> V Add(V a, V b)
+		{
+			return a + b;
+		}
+		template <typename V> V Mul(V a, V b)
+		{
+			return a * b;
+		}
+#if defined(__AVX2__)
+		template <> inline __m256 Splat<__m256>(double c)
+		{
+			return _mm256_set1_ps(float(c));
+		}
+		inline __m256 Add(__m256 a, __m256 b)
+		{
+			return _mm256_add_ps(a, b);
+		}
+		inline __m256 Mul(__m256 a, __m256 b)
+		{
+			return _mm256_mul_ps(a, b);
+		}
+#endif
+		// c0 + x (c1 + x (c2 + ...))
+		template <typename V> V Horner(V, double c)
+		{
+			return Splat<V>(c);
+		}
+		template <typename V, typename... C> V Horner(V x, double c, C... rest)
+		{
+			return Add(Splat<V>(c), Mul(x, Horner(x, rest...)));
+		}
+
+		// atan on [0, 1] (Abramowitz & Stegun 4.4.47), sin and cos on
+		// [-pi/4, pi/4] (Taylor)
+		struct fast_polynomials
+		{
+			template <typename V> static V Atan(V a)
+			{
+				return Mul(a, Horner(Mul(a, a), 0.9998660, -0.3302995, 0.1801410, -0.0851330, 0.0208351));
+			}
+			template <typename V> static V Sin(V r)
+			{
+				return Mul(r, Horner(Mul(r, r), 1.0, -1.0 / 6.0, 1.0 / 120.0));
+			}
+			template <typename V> static V Cos(V r)
+			{
+				return Horner(Mul(r, r), 1.0, -0.5, 1.0 / 24.0, -1.0 / 720.0);
+			}
+		};
+		// atan from Abramowitz & Stegun 4.4.49
+		struct precise_polynomials
+		{
+			template <typename V> static V Atan(V a)
+			{
+				return Mul(a, Horner(Mul(a, a), 0.9999993329, -0.3332985605, 0.1994653599, -0.1390853351,
+					0.0964200441, -0.0559098861, 0.0218612288, -0.0040540580));
+			}
+			template <typename V> static V Sin(V r)
+			{
+				return Mul(r, Horner(Mul(r, r), 1.0, -1.0 / 6.0, 1.0 / 120.0, -1.0 / 5040.0, 1.0 / 362880.0));
+			}
+			template <typename V> static V Cos(V r)
+			{
+				return Horner(Mul(r, r), 1.0, -0.5, 1.0 / 24.0, -1.0 / 720.0, 1.0 / 40320.0, -1.0 / 3628800.0);
+			}
+		};
+
+		// Trig policies work a block at a time: out = atan2(y, x) * scale
+		// and (s, c) = sincos(angle * scale).
+		template <typename Polynomials> struct polynomial_trig
+		{
+			// octant reduction to atan on [0, 1], atan2(-0, x) is +0 / pi
+			template <typename T> static T Atan2(T y, T x)
+			{
+				const T ax = T(fabs(x)), ay = T(fabs(y));
+				const T high = ax > ay ? ax : ay, low = ax > ay ? ay : ax;
+				T r = Polynomials::Atan(low / (high > T(0) ? high : T(1)));
+				r = ay > ax ? T(constants<T>::half_pi) - r : r;
+				r = x < T(0) ? T(constants<T>::pi) - r : r;
+				return y < T(0) ? -r : r;
+			}
+			// quadrant reduction to [-pi/4, pi/4]
+			template <typename T> static void SinCos(T angle, T& s, T& c)
+			{
+				const T k = T(floor(angle * (T(1) / T(constants<T>::half_pi)) + T(0.5)));
+				const T r = (angle - k * half_pi_split<T>::hi) - k * half_pi_split<T>::lo;
+				const int q = int(k) & 3;
+				const T sr = Polynomials::Sin(r), cr = Polynomials::Cos(r);
+				const T s0 = (q & 1) ? cr : sr, c0 = (q & 1) ? sr : cr;
+				s = (q & 2) ? -s0 : s0;
+				c = ((q + 1) & 2) ? -c0 : c0;
+			}
+
+			template <typename T> static void Atan2Block(const T* y, const T* x, size_t n, T scale, T* out)
+			{
+				for (size_t j = 0; j < n; j++)
+					out[j] = Atan2(y[j], x[j]) * scale;
+			}
+			template <typename T> static void SinCosBlock(const T* angle, size_t n, T scale, T* s, T* c)
+			{
+				for (size_t j = 0; j < n; j++)
+					SinCos(angle[j] * scale, s[j], c[j]);
+			}
+
+#if defined(__AVX2__)
+			static void Atan2Block(const float* y, const float* x, size_t n, float scale, float* out)
+			{
+				const __m256 sign = _mm256_set1_ps(-0.0f), zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+				const __m256 half_pi = _mm256_set1_ps(constants<float>::half_pi), pi = _mm256_set1_ps(constants<float>::pi);
+				const __m256 factor = _mm256_set1_ps(scale);
+				size_t j = 0;
+				for (; j + 8 <= n; j += 8)
+				{
+					const __m256 vy = _mm256_loadu_ps(y + j), vx = _mm256_loadu_ps(x + j);
+					const __m256 ax = _mm256_andnot_ps(sign, vx), ay = _mm256_andnot_ps(sign, vy);
+					const __m256 high = _mm256_max_ps(ax, ay), low = _mm256_min_ps(ax, ay);
+					const __m256 divisor = _mm256_blendv_ps(one, high, _mm256_cmp_ps(high, zero, _CMP_GT_OQ));
+					__m256 r = Polynomials::Atan(_mm256_div_ps(low, divisor));
+					r = _mm256_blendv_ps(r, _mm256_sub_ps(half_pi, r), _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+					r = _mm256_blendv_ps(r, _mm256_sub_ps(pi, r), _mm256_cmp_ps(vx, zero, _CMP_LT_OQ));
+					r = _mm256_blendv_ps(r, _mm256_xor_ps(r, sign), _mm256_cmp_ps(vy, zero, _CMP_LT_OQ));
+					_mm256_storeu_ps(out + j, _mm256_mul_ps(r, factor));
+				}
+				if (j < n)
+					Atan2Block<float>(y + j, x + j, n - j, scale, out + j);
+			}
+			static void SinCosBlock(const float* angle, size_t n, float scale, float* s, float* c)
+			{
+				const __m256 factor = _mm256_set1_ps(scale);
+				const __m256 inverse_half_pi = _mm256_set1_ps(1.0f / constants<float>::half_pi);
+				const __m256 hi = _mm256_set1_ps(half_pi_split<float>::hi), lo = _mm256_set1_ps(half_pi_split<float>::lo);
+				const __m256i one = _mm256_set1_epi32(1), two = _mm256_set1_epi32(2);
+				size_t j = 0;
+				for (; j + 8 <= n; j += 8)
+				{
+					const __m256 a = _mm256_mul_ps(_mm256_loadu_ps(angle + j), factor);
+					const __m256 k = _mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(a, inverse_half_pi), _mm256_set1_ps(0.5f)));
+					const __m256 r = _mm256_sub_ps(_mm256_sub_ps(a, _mm256_mul_ps(k, hi)), _mm256_mul_ps(k, lo));
+					const __m256i q = _mm256_cvtps_epi32(k);
+					const __m256 sr = Polynomials::Sin(r), cr = Polynomials::Cos(r);
+					const __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, one), one));
+					const __m256 s0 = _mm256_blendv_ps(sr, cr, swap), c0 = _mm256_blendv_ps(cr, sr, swap);
+					// bit 1 of q, and of q + 1, moved to the sign bit
+					const __m256 s_sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(q, two), 30));
+					const __m256 c_sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(q, one), two), 30));
+					_mm256_storeu_ps(s + j, _mm256_xor_ps(s0, s_sign));
+					_mm256_storeu_ps(c + j, _mm256_xor_ps(c0, c_sign));
+				}
+				if (j < n)
+					SinCosBlock<float>(angle + j, n - j, scale, s + j, c + j);
+			}
+#endif
+		};
+		struct library_trig
+		{
+			template <typename T> static void Atan2Block(const T* y, const T* x, size_t n, T scale, T* out)
+			{
+				for (size_t j = 0; j < n; j++)
+					out[j] = T(atan2(y[j], x[j])) * scale;
+			}
+			template <typename T> static void SinCosBlock(const T* angle, size_t n, T scale, T* s, T* c)
+			{
+				for (size_t j = 0; j < n; j++)
+				{
+					s[j] = T(sin(angle[j] * scale));
+					c[j] = T(cos(angle[j] * scale));
+				}
+			}
+		};
+
+		template <typename Trig, angle_unit U, typename T>
+		void ToSpherical(const vec3<T>* points, size_t count,
+			T* radius, angle<U, T>* azimuth, angle<U, T>* elevation)
+		{
+			const T scale = T(1) / RadiansPerUnit<U, T>();
+			ParallelFor(count, coordinates_grain, [points, radius, azimuth, elevation, scale](size_t begin, size_t end)
+				{
+					T x[coordinates_block], y[coordinates_block], z[coordinates_block], planar[coordinates_block];
+					T az[coordinates_block], el[coordinates_block];
+					for (size_t i = begin; i < end; i += coordinates_block)
+					{
+						const size_t n = (end - i < coordinates_block) ? end - i : coordinates_block;
+						for (size_t j = 0; j < n; j++)
+						{
+							x[j] = points[i + j].x;
+							y[j] = points[i + j].y;
+							z[j] = points[i + j].z;
+						}
+						for (size_t j = 0; j < n; j++)
+							planar[j] = T(sqrt(x[j] * x[j] + y[j] * y[j]));
+						Trig::Atan2Block(y, x, n, scale, az);
+						Trig::Atan2Block(z, planar, n, scale, el);
+						for (size_t j = 0; j < n; j++)
+						{
+							azimuth[i + j].value() = az[j];
+							elevation[i + j].value() = el[j];
+						}
+						if (radius)
+						{
+							for (size_t j = 0; j < n; j++)
+								radius[i + j] = T(sqrt(planar[j] * planar[j] + z[j] * z[j]));
+						}
+					}
+				});
+		}
+		template <typename Trig, angle_unit U, typename T>
+		void FromSpherical(const T* radius, const angle<U, T>* azimuth, const angle<U, T>* elevation,
+			size_t count, vec3<T>* points)
+		{
+			const T scale = RadiansPerUnit<U, T>();
+			ParallelFor(count, coordinates_grain, [radius, azimuth, elevation, points, scale](size_t begin, size_t end)
+				{
+					T az[coordinates_block], el[coordinates_block];
+					T sa[coordinates_block], ca[coordinates_block], se[coordinates_block], ce[coordinates_block];
+					for (size_t i = begin; i < end; i += coordinates_block)
+					{
+						const size_t n = (end - i < coordinates_block) ? end - i : coordinates_block;
+						for (size_t j = 0; j < n; j++)
+						{
+							az[j] = azimuth[i + j].value();
+							el[j] = elevation[i + j].value();
+						}
+						Trig::SinCosBlock(az, n, scale, sa, ca);
+						Trig::SinCosBlock(el, n, scale, se, ce);
+						for (size_t j = 0; j < n; j++)
+						{
+							const T planar = radius[i + j] * ce[j];
+							points[i + j].x = planar * ca[j];
+							points[i + j].y = planar * sa[j];
+							points[i + j].z = radius[i + j] * se[j];
+						}
+					}
+				});
+		}
+
+		template <typename Trig, angle_unit U, typename T>
+		void ToPolar(const vec2<T>* points, size_t count, T* radius, angle<U, T>* theta)
+		{
+			const T scale = T(1) / RadiansPerUnit<U, T>();
+			ParallelFor(count, coordinates_grain, [points, radius, theta, scale](size_t begin, size_t end)
+				{
+					T x[coordinates_block], y[coordinates_block], th[coordinates_block];
+					for (size_t i = begin; i < end; i += coordinates_block)
+					{
+						const size_t n = (end - i < coordinates_block) ? end - i : coordinates_block;
+						for (size_t j = 0; j < n; j++)
+						{
+							x[j] = points[i + j].x;
+							y[j] = points[i + j].y;
+						}
+						Trig::Atan2Block(y, x, n, scale, th);
+						for (size_t j = 0; j < n; j++)
+							theta[i + j].value() = th[j];
+						if (radius)
+						{
+							for (size_t j = 0; j < n; j++)
+								radius[i + j] = T(sqrt(x[j] * x[j] + y[j] * y[j]));
+						}
+					}
+				});
+		}
+		template <typename Trig, angle_unit U, typename T>
+		void FromPolar(const T* radius, const angle<U, T>* theta, size_t count, vec2<T>* points)
+		{
+			const T scale = RadiansPerUnit<U, T>();
+			ParallelFor(count, coordinates_grain, [radius, theta, points, scale](size_t begin, size_t end)
+				{
+					T th[coordinates_block], s[coordinates_block], c[coordinates_block];
+					for (size_t i = begin; i < end; i += coordinates_block)
+					{
+						const size_t n = (end - i < coordinates_block) ? end - i : coordinates_block;
+						for (size_t j = 0; j < n; j++)
+							th[j] = theta[i + j].value();
+						Trig::SinCosBlock(th, n, scale, s, c);
+						for (size_t j = 0; j < n; j++)
+						{
+							points[i + j].x = radius[i + j] * c[j];
+							points[i + j].y = radius[i + j] * s[j];
+						}
+					}
+				});
+		}
+	}
+
+
+	// radius may be null when only the directions are needed
+	template <angle_unit U, typename T> void CartesianToSpherical(const vec3<T>* points, size_t count,
+		T* radius, angle<U, T>* azimuth, angle<U, T>* elevation,
+		trig_accuracy accuracy = trig_accuracy::precise)
+	{
+		switch (accuracy)
+		{
+			case trig_accuracy::fast:
+				detail::ToSpherical<detail::polynomial_trig<detail::fast_polynomials>>(points, count, radius, azimuth, elevation);
+				break;
+			case trig_accuracy::precise:
+				detail::ToSpherical<detail::polynomial_trig<detail::precise_polynomials>>(points, count, radius, azimuth, elevation);
+				break;
+			default:
+				detail::ToSpherical<detail::library_trig>(points, count, radius, azimuth, elevation);
+		}
+	}
+	template <angle_unit U, typename T> void SphericalToCartesian(const T* radius,
+		const angle<U, T>* azimuth, const angle<U, T>* elevation, size_t count, vec3<T>* points,
+		trig_accuracy accuracy = trig_accuracy::precise)
+	{
+		switch (accuracy)
+		{
+			case trig_accuracy::fast:
+				detail::FromSpherical<detail::polynomial_trig<detail::fast_polynomials>>(radius, azimuth, elevation, count, points);
+				break;
+			case trig_accuracy::precise:
+				detail::FromSpherical<detail::polynomial_trig<detail::precise_polynomials>>(radius, azimuth, elevation, count, points);
+				break;
+			default:
+				detail::FromSpherical<detail::library_trig>(radius, azimuth, elevation, count, points);
+		}
+	}
+
+	// radius may be null when only the angles are needed
+	template <angle_unit U, typename T> void CartesianToPolar(const vec2<T>* points, size_t count,
+		T* radius, angle<U, T>* theta, trig_accuracy accuracy = trig_accuracy::precise)
+	{
+		switch (accuracy)
+		{
+			case trig_accuracy::fast:
+				detail::ToPolar<detail::polynomial_trig<detail::fast_polynomials>>(points, count, radius, theta);
+				break;
+			case trig_accuracy::precise:
+				detail::ToPolar<detail::polynomial_trig<detail::precise_polynomials>>(points, count, radius, theta);
+				break;
+			default:
+				detail::ToPolar<detail::library_trig>(points, count, radius, theta);
+		}
+	}
+	template <angle_unit U, typename T> void PolarToCartesian(const T* radius, const angle<U, T>* theta,
+		size_t count, vec2<T>* points, trig_accuracy accuracy = trig_accuracy::precise)
+	{
+		switch (accuracy)
+		{
+			case trig_accuracy::fast:
+				detail::FromPolar<detail::polynomial_trig<detail::fast_polynomials>>(radius, theta, count, points);
+				break;
+			case trig_accuracy::precise:
+				detail::FromPolar<detail::polynomial_trig<detail::precise_polynomials>>(radius, theta, count, points);
+				break;
+			default:
+				detail::FromPolar<detail::library_trig>(radius, theta, count, points);
+		}
+	}
+}
+
+#endif // !COORDINATES_H
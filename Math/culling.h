@@ -0,0 +1,371 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include "parallel.h"
+#include "reduction.h"
+#include "vec3.h"
+
+#include <math.h>	// sqrt(), fabs()
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>	// memmove()
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace Math
+{
+	// Plane and frustum types with bulk culling of bounding spheres and
+	// boxes. Objects are classified a block at a time against all planes:
+	// for every plane the signed distance of the centre is compared with
+	// the radius, or for boxes with the half extent projected on the
+	// normal, so the kernels stay branch free and run 8 objects per
+	// instruction in float with AVX2 and auto-vectorized otherwise. AoS
+	// input is transposed per block into SoA form first.
+	//
+	// Cull* write the ascending indices of all objects not outside into a
+	// compact list, which must have room for count indices, and return
+	// its length.
+
+	enum class containment : uint8_t
+	{
+		outside,
+		intersecting,
+		inside
+	};
+
+	// points p with Dot(normal, p) + distance >= 0 are on the inner side
+	template <typename T> struct plane
+	{
+	public:
+		vec3<T> normal;
+		T distance;
+
+	public:
+		plane()
+			: normal()
+			, distance(T(0))
+		{}
+		plane(const vec3<T>& normal, T distance)
+			: normal(normal)
+			, distance(distance)
+		{}
+		plane(const vec3<T>& normal, const vec3<T>& point)
+			: normal(normal)
+			, distance(-(normal.x * point.x + normal.y * point.y + normal.z * point.z))
+		{}
+
+	public:
+		T SignedDistance(const vec3<T>& p) const
+		{
+			return normal.x * p.x + normal.y * p.y + normal.z * p.z + distance;
+		}
+		void Normalize()
+		{
+			const T inv = T(1) / T(sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z));
+			normal = vec3<T>(normal.x * inv, normal.y * inv, normal.z * inv);
+			distance *= inv;
+		}
+	};
+
+	// six inward facing planes: left, right, bottom, top, near, far
+	template <typename T> struct frustum
+	{
+	public:
+		plane<T> planes[6];
+
+	public:
+		// Gribb and Hartmann extraction from a row major view projection
+		// matrix m (clip = m * point), with clip depth in [-1, 1] or [0, 1]
+		static frustum FromViewProjection(const T* m, bool depth_zero_to_one = false)
+		{
+			frustum f;
+			const T* r0 = m;
+			const T* r1 = m + 4;
+			const T* r2 = m + 8;
+			const T* r3 = m + 12;
+			for (unsigned int i = 0; i < 6; i++)
+			{
+				const T* r = (i < 2) ? r0 : (i < 4 ? r1 : r2);
+				const T s = (i & 1) ? T(-1) : T(1);
+				T p[4];
+				for (unsigned int k = 0; k < 4; k++)
+					p[k] = (i == 4 && depth_zero_to_one) ? r[k] : r3[k] + s * r[k];
+				f.planes[i] = plane<T>(vec3<T>(p[0], p[1], p[2]), p[3]);
+				f.planes[i].Normalize();
+			}
+			return f;
+		}
+	};
+
+	template <typename T> struct sphere
+	{
+		vec3<T> center;
+		T radius;
+	};
+
+	// structure of arrays views
+	template <typename T> struct sphere_arrays
+	{
+		const T *x, *y, *z, *radius;
+	};
+	template <typename T> struct box_arrays
+	{
+		const T *min_x, *min_y, *min_z, *max_x, *max_y, *max_z;
+	};
+
+
+	namespace detail
+	{
+		constexpr size_t culling_block = 64u;
+		constexpr size_t culling_grain = 16384u;
+
+		template <typename T> struct frustum_lanes
+		{
+			T nx[6], ny[6], nz[6], d[6], ax[6], ay[6], az[6];
+
+			explicit frustum_lanes(const frustum<T>& f)
+			{
+				for (unsigned int p = 0; p < 6; p++)
+				{
+					nx[p] = f.planes[p].normal.x;
+					ny[p] = f.planes[p].normal.y;
+					nz[p] = f.planes[p].normal.z;
+					d[p] = f.planes[p].distance;
+					ax[p] = T(fabs(nx[p]));
+					ay[p] = T(fabs(ny[p]));
+					az[p] = T(fabs(nz[p]));
+				}
+			}
+		};
+
+		// centre c and per plane radius: outside once any distance is below
+		// -radius, intersecting while any is below +radius. Boxes pass their
+		// half extent in (ex, ey, ez), spheres a radius in ex and null ey.
+		template <typename T> void ClassifyBlock(const frustum_lanes<T>& f,
+			const T* cx, const T* cy, const T* cz, const T* ex, const T* ey, const T* ez, size_t n, uint8_t* state)
+		{
+			uint8_t outside[culling_block], straddle[culling_block];
+			for (size_t j = 0; j < n; j++)
+			{
+				outside[j] = 0u;
+				straddle[j] = 0u;
+			}
+			for (unsigned int p = 0; p < 6; p++)
+			{
+				const T nx = f.nx[p], ny = f.ny[p], nz = f.nz[p], d = f.d[p];
+				if (ey)
+				{
+					const T ax = f.ax[p], ay = f.ay[p], az = f.az[p];
+					for (size_t j = 0; j < n; j++)
+					{
+						const T distance = nx * cx[j] + ny * cy[j] + nz * cz[j] + d;
+						const T radius = ax * ex[j] + ay * ey[j] + az * ez[j];
+						outside[j] |= uint8_t(distance < -radius);
+						straddle[j] |= uint8_t(distance < radius);
+					}
+				}
+				else
+				{
+					for (size_t j = 0; j < n; j++)
+					{
+						const T distance = nx * cx[j] + ny * cy[j] + nz * cz[j] + d;
+						outside[j] |= uint8_t(distance < -ex[j]);
+						straddle[j] |= uint8_t(distance < ex[j]);
+					}
+				}
+			}
+			for (size_t j = 0; j < n; j++)
+				state[j] = uint8_t(outside[j] ? 0u : (straddle[j] ? 1u : 2u));
+		}
+
+#if defined(__AVX2__)
+		inline void ClassifyBlock(const frustum_lanes<float>& f,
+			const float* cx, const float* cy, const float* cz, const float* ex, const float* ey, const float* ez, size_t n, uint8_t* state)
+		{
+			const __m256 sign = _mm256_set1_ps(-0.0f);
+			size_t j = 0;
+			for (; j + 8 <= n; j += 8)
+			{
+				const __m256 x = _mm256_loadu_ps(cx + j), y = _mm256_loadu_ps(cy + j), z = _mm256_loadu_ps(cz + j);
+				const __m256 e0 = _mm256_loadu_ps(ex + j);
+				const __m256 e1 = ey ? _mm256_loadu_ps(ey + j) : _mm256_setzero_ps();
+				const __m256 e2 = ey ? _mm256_loadu_ps(ez + j) : _mm256_setzero_ps();
+				__m256 outside = _mm256_setzero_ps(), straddle = _mm256_setzero_ps();
+				for (unsigned int p = 0; p < 6; p++)
+				{
+					__m256 distance = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(f.nx[p]), x), _mm256_set1_ps(f.d[p]));
+					distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(f.ny[p]), y));
+					distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(f.nz[p]), z));
+					__m256 radius = e0;
+					if (ey)
+					{
+						radius = _mm256_mul_ps(_mm256_set1_ps(f.ax[p]), e0);
+						radius = _mm256_add_ps(radius, _mm256_mul_ps(_mm256_set1_ps(f.ay[p]), e1));
+						radius = _mm256_add_ps(radius, _mm256_mul_ps(_mm256_set1_ps(f.az[p]), e2));
+					}
+					outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, _mm256_xor_ps(radius, sign), _CMP_LT_OQ));
+					straddle = _mm256_or_ps(straddle, _mm256_cmp_ps(distance, radius, _CMP_LT_OQ));
+				}
+				const int out_bits = _mm256_movemask_ps(outside), straddle_bits = _mm256_movemask_ps(straddle);
+				for (unsigned int k = 0; k < 8; k++)
+					state[j + k] = uint8_t(((out_bits >> k) & 1) ? 0u : (((straddle_bits >> k) & 1) ? 1u : 2u));
+			}
+			if (j < n)
+			{
+				ClassifyBlock<float>(f, cx + j, cy + j, cz + j, ex + j, ey ? ey + j : nullptr, ey ? ez + j : nullptr, n - j, state + j);
+			}
+		}
+#endif
+
+		// the block [begin, begin + n) of each input layout as SoA arrays
+		template <typename T> struct culling_block_arrays
+		{
+			T cx[culling_block], cy[culling_block], cz[culling_block];
+			T ex[culling_block], ey[culling_block], ez[culling_block];
+		};
+
+		template <typename T> void ClassifyRange(const frustum_lanes<T>& f, const sphere<T>* spheres,
+			size_t begin, size_t n, culling_block_arrays<T>& buffer, uint8_t* state)
+		{
+			for (size_t j = 0; j < n; j++)
+			{
+				const sphere<T>& s = spheres[begin + j];
+				buffer.cx[j] = s.center.x;
+				buffer.cy[j] = s.center.y;
+				buffer.cz[j] = s.center.z;
+				buffer.ex[j] = s.radius;
+			}
+			ClassifyBlock(f, buffer.cx, buffer.cy, buffer.cz, buffer.ex, (const T*)nullptr, (const T*)nullptr, n, state);
+		}
+		template <typename T> void ClassifyRange(const frustum_lanes<T>& f, const sphere_arrays<T>& spheres,
+			size_t begin, size_t n, culling_block_arrays<T>&, uint8_t* state)
+		{
+			ClassifyBlock(f, spheres.x + begin, spheres.y + begin, spheres.z + begin, spheres.radius + begin,
+				(const T*)nullptr, (const T*)nullptr, n, state);
+		}
+		template <typename T> void ClassifyRange(const frustum_lanes<T>& f, const bounds<vec3<T>>* boxes,
+			size_t begin, size_t n, culling_block_arrays<T>& buffer, uint8_t* state)
+		{
+			for (size_t j = 0; j < n; j++)
+			{
+				const bounds<vec3<T>>& b = boxes[begin + j];
+				buffer.cx[j] = (b.min.x + b.max.x) * T(0.5);
+				buffer.cy[j] = (b.min.y + b.max.y) * T(0.5);
+				buffer.cz[j] = (b.min.z + b.max.z) * T(0.5);
+				buffer.ex[j] = (b.max.x - b.min.x) * T(0.5);
+				buffer.ey[j] = (b.max.y - b.min.y) * T(0.5);
+				buffer.ez[j] = (b.max.z - b.min.z) * T(0.5);
+			}
+			ClassifyBlock(f, buffer.cx, buffer.cy, buffer.cz, buffer.ex, buffer.ey, buffer.ez, n, state);
+		}
+		template <typename T> void ClassifyRange(const frustum_lanes<T>& f, const box_arrays<T>& boxes,
+			size_t begin, size_t n, culling_block_arrays<T>& buffer, uint8_t* state)
+		{
+			for (size_t j = 0; j < n; j++)
+			{
+				const size_t i = begin + j;
+				buffer.cx[j] = (boxes.min_x[i] + boxes.max_x[i]) * T(0.5);
+				buffer.cy[j] = (boxes.min_y[i] + boxes.max_y[i]) * T(0.5);
+				buffer.cz[j] = (boxes.min_z[i] + boxes.max_z[i]) * T(0.5);
+				buffer.ex[j] = (boxes.max_x[i] - boxes.min_x[i]) * T(0.5);
+				buffer.ey[j] = (boxes.max_y[i] - boxes.min_y[i]) * T(0.5);
+				buffer.ez[j] = (boxes.max_z[i] - boxes.min_z[i]) * T(0.5);
+			}
+			ClassifyBlock(f, buffer.cx, buffer.cy, buffer.cz, buffer.ex, buffer.ey, buffer.ez, n, state);
+		}
+
+		template <typename T, typename Input> void Classify(const frustum<T>& f, const Input& input, size_t count, containment* states)
+		{
+			const frustum_lanes<T> lanes(f);
+			ParallelFor(count, culling_grain, [&lanes, &input, states](size_t begin, size_t end)
+				{
+					culling_block_arrays<T> buffer;
+					uint8_t state[culling_block];
+					for (size_t i = begin; i < end; i += culling_block)
+					{
+						const size_t n = (end - i < culling_block) ? end - i : culling_block;
+						ClassifyRange(lanes, input, i, n, buffer, state);
+						for (size_t j = 0; j < n; j++)
+							states[i + j] = containment(state[j]);
+					}
+				});
+		}
+
+		// chunks write their indices in place, then slide down in order
+		template <typename T, typename Input> size_t Cull(const frustum<T>& f, const Input& input, size_t count, uint32_t* visible)
+		{
+			const frustum_lanes<T> lanes(f);
+			const size_t chunks = (count + culling_grain - 1) / culling_grain;
+			std::vector<size_t> found(chunks);
+			ParallelForChunks(count, culling_grain, [&lanes, &input, visible, &found](size_t chunk, size_t begin, size_t end)
+				{
+					culling_block_arrays<T> buffer;
+					uint8_t state[culling_block];
+					uint32_t* out = visible + begin;
+					size_t written = 0u;
+					for (size_t i = begin; i < end; i += culling_block)
+					{
+						const size_t n = (end - i < culling_block) ? end - i : culling_block;
+						ClassifyRange(lanes, input, i, n, buffer, state);
+						for (size_t j = 0; j < n; j++)
+						{
+							out[written] = uint32_t(i + j);
+							written += state[j] != 0u;
+						}
+					}
+					found[chunk] = written;
+				});
+
+			size_t total = 0u;
+			for (size_t c = 0; c < chunks; c++)
+			{
+				if (total != c * culling_grain)
+					memmove(visible + total, visible + c * culling_grain, found[c] * sizeof(uint32_t));
+				total += found[c];
+			}
+			return total;
+		}
+	}
+
+
+	// per object containment
+	template <typename T> void ClassifySpheres(const frustum<T>& f, const sphere<T>* spheres, size_t count, containment* states)
+	{
+		detail::Classify(f, spheres, count, states);
+	}
+	template <typename T> void ClassifySpheres(const frustum<T>& f, const sphere_arrays<T>& spheres, size_t count, containment* states)
+	{
+		detail::Classify(f, spheres, count, states);
+	}
+	template <typename T> void ClassifyBoxes(const frustum<T>& f, const bounds<vec3<T>>* boxes, size_t count, containment* states)
+	{
+		detail::Classify(f, boxes, count, states);
+	}
+	template <typename T> void ClassifyBoxes(const frustum<T>& f, const box_arrays<T>& boxes, size_t count, containment* states)
+	{
+		detail::Classify(f, boxes, count, states);
+	}
+
+	// indices of objects inside or intersecting, visible holds count entries
+	template <typename T> size_t CullSpheres(const frustum<T>& f, const sphere<T>* spheres, size_t count, uint32_t* visible)
+	{
+		return detail::Cull(f, spheres, count, visible);
+	}
+	template <typename T> size_t CullSpheres(const frustum<T>& f, const sphere_arrays<T>& spheres, size_t count, uint32_t* visible)
+	{
+		return detail::Cull(f, spheres, count, visible);
+	}
+	template <typename T> size_t CullBoxes(const frustum<T>& f, const bounds<vec3<T>>* boxes, size_t count, uint32_t* visible)
+	{
+		return detail::Cull(f, boxes, count, visible);
+	}
+	template <typename T> size_t CullBoxes(const frustum<T>& f, const box_arrays<T>& boxes, size_t count, uint32_t* visible)
+	{
+		return detail::Cull(f, boxes, count, visible);
+	}
+}
+
+#endif // !CULLING_H
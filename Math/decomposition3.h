@@ -0,0 +1,478 @@
+#ifndef DECOMPOSITION3_H
+#define DECOMPOSITION3_H
+
+#include "matrix_batch.h"
+#include "parallel.h"
+#include "reduction.h"
+#include "vec3.h"
+
+#include <math.h>	// sqrt(), acos(), atan2(), cos(), sin(), fabs()
+#include <stddef.h>
+
+namespace Math
+{
+	// Decompositions of 3x3 matrices for principal axes, oriented boxes
+	// and shape matching.
+	//
+	// EigenSymmetric is closed form without iterations: the trigonometric
+	// solution of the characteristic cubic picks the best separated
+	// eigenvalue, its eigenvector comes from cross products of the shifted
+	// rows (Eberly, "A Robust Eigensolver for 3x3 Symmetric Matrices"),
+	// the other two from the 2x2 rotation angle in the orthogonal
+	// complement, and the eigenvalues are refined as Rayleigh quotients.
+	// Repeated and nearly repeated eigenvalues come out to a few ulps.
+	//
+	// Svd and Polar run over matrix_batch lanes: a fixed number of cyclic
+	// Jacobi sweeps on A^T A gives V, the columns of A V are sorted by
+	// length and a Givens QR of A V gives U and the singular values
+	// (McAdams et al., "Computing the Singular Value Decomposition of 3x3
+	// matrices with minimal branching and elementary floating point
+	// operations"). Every step is branch free, so each loop over the W
+	// lanes of a block compiles to SIMD code.
+
+	// symmetric 3x3 matrix by its upper triangle
+	template <typename T> struct symmetric3
+	{
+	public:
+		T xx, yy, zz, xy, xz, yz;
+
+	public:
+		symmetric3()
+			: xx(0), yy(0), zz(0), xy(0), xz(0), yz(0)
+		{}
+		symmetric3(T xx, T yy, T zz, T xy, T xz, T yz)
+			: xx(xx), yy(yy), zz(zz), xy(xy), xz(xz), yz(yz)
+		{}
+	};
+
+	// ascending eigenvalues with unit eigenvectors forming a right handed
+	// basis, vectors[i] belongs to values[i] (x, y, z)
+	template <typename T> struct eigen3
+	{
+		vec3<T> values;
+		vec3<T> vectors[3];
+	};
+
+	// A = U diag(values) V^T with U and V rotations, columns as vec3. The
+	// values are sorted by magnitude, descending; the last one is negative
+	// when det(A) < 0.
+	template <typename T> struct svd3
+	{
+		vec3<T> u[3];
+		vec3<T> values;
+		vec3<T> v[3];
+	};
+
+	namespace detail
+	{
+		template <typename T> vec3<T> ShiftedRowsNull(const symmetric3<T>& a, T value)
+		{
+			const vec3<T> row0(a.xx - value, a.xy, a.xz);
+			const vec3<T> row1(a.xy, a.yy - value, a.yz);
+			const vec3<T> row2(a.xz, a.yz, a.zz - value);
+			const vec3<T> r01 = vec3<T>::CrossProduct(row0, row1);
+			const vec3<T> r02 = vec3<T>::CrossProduct(row0, row2);
+			const vec3<T> r12 = vec3<T>::CrossProduct(row1, row2);
+			const T d01 = vec3<T>::DotProduct(r01, r01);
+			const T d02 = vec3<T>::DotProduct(r02, r02);
+			const T d12 = vec3<T>::DotProduct(r12, r12);
+
+			if (d01 >= d02 && d01 >= d12) return r01 / T(sqrt(d01));
+			if (d02 >= d12) return r02 / T(sqrt(d02));
+			return r12 / T(sqrt(d12));
+		}
+		template <typename T> void OrthogonalComplement(const vec3<T>& w, vec3<T>& u, vec3<T>& v)
+		{
+			if (fabs(w.x) > fabs(w.y))
+			{
+				const T r_length = T(1) / T(sqrt(w.x * w.x + w.z * w.z));
+				u = vec3<T>(-w.z * r_length, T(0), w.x * r_length);
+			}
+			else
+			{
+				const T r_length = T(1) / T(sqrt(w.y * w.y + w.z * w.z));
+				u = vec3<T>(T(0), w.z * r_length, -w.y * r_length);
+			}
+			v = vec3<T>::CrossProduct(w, u);
+		}
+		template <typename T> vec3<T> Multiply(const symmetric3<T>& a, const vec3<T>& v)
+		{
+			return vec3<T>(
+				a.xx * v.x + a.xy * v.y + a.xz * v.z,
+				a.xy * v.x + a.yy * v.y + a.yz * v.z,
+				a.xz * v.x + a.yz * v.y + a.zz * v.z);
+		}
+		// eigenvectors of a restricted to the plane orthogonal to the
+		// eigenvector w, from the closed form 2x2 rotation angle so close
+		// eigenvalues don't depend on the accuracy of the cubic's roots
+		template <typename T> void ComplementEigenvectors(const symmetric3<T>& a, const vec3<T>& w,
+			vec3<T>& larger, vec3<T>& smaller)
+		{
+			vec3<T> u, v;
+			OrthogonalComplement(w, u, v);
+			const vec3<T> au = Multiply(a, u), av = Multiply(a, v);
+			const T m00 = vec3<T>::DotProduct(u, au);
+			const T m01 = vec3<T>::DotProduct(u, av);
+			const T m11 = vec3<T>::DotProduct(v, av);
+
+			const T angle = T(0.5) * T(atan2(T(2) * m01, m00 - m11));
+			const T c = T(cos(angle)), s = T(sin(angle));
+			larger = u * c + v * s;
+			smaller = v * c - u * s;
+		}
+	}
+
+
+	template <typename T> eigen3<T> EigenSymmetric(const symmetric3<T>& A)
+	{
+		eigen3<T> result;
+
+		// scaled to the largest element against over- and underflow
+		T largest = T(fabs(A.xx));
+		const T elements[5] = { A.yy, A.zz, A.xy, A.xz, A.yz };
+		for (unsigned int i = 0; i < 5; i++)
+		{
+			if (T(fabs(elements[i])) > largest) largest = T(fabs(elements[i]));
+		}
+		const T off = A.xy * A.xy + A.xz * A.xz + A.yz * A.yz;
+		if (largest == T(0) || off == T(0))
+		{
+			// diagonal
+			T values[3] = { A.xx, A.yy, A.zz };
+			vec3<T> vectors[3] = { vec3<T>(T(1), T(0), T(0)), vec3<T>(T(0), T(1), T(0)), vec3<T>(T(0), T(0), T(1)) };
+			for (unsigned int i = 0; i < 2; i++)
+			{
+				for (unsigned int j = 0; j < 2 - i; j++)
+				{
+					if (values[j + 1] < values[j])
+					{
+						const T value = values[j]; values[j] = values[j + 1]; values[j + 1] = value;
+						const vec3<T> vector = vectors[j]; vectors[j] = vectors[j + 1]; vectors[j + 1] = vector;
+					}
+				}
+			}
+			result.values = vec3<T>(values[0], values[1], values[2]);
+			result.vectors[0] = vectors[0];
+			result.vectors[1] = vectors[1];
+			// keep the basis right handed
+			result.vectors[2] = vec3<T>::CrossProduct(vectors[0], vectors[1]);
+			return result;
+		}
+
+		const T r_largest = T(1) / largest;
+		const symmetric3<T> a(A.xx * r_largest, A.yy * r_largest, A.zz * r_largest,
+			A.xy * r_largest, A.xz * r_largest, A.yz * r_largest);
+
+		const T q = (a.xx + a.yy + a.zz) / T(3);
+		const T b00 = a.xx - q, b11 = a.yy - q, b22 = a.zz - q;
+		const T p = T(sqrt((b00 * b00 + b11 * b11 + b22 * b22 +
+			T(2) * (a.xy * a.xy + a.xz * a.xz + a.yz * a.yz)) / T(6)));
+		const T c00 = b11 * b22 - a.yz * a.yz;
+		const T c01 = a.xy * b22 - a.yz * a.xz;
+		const T c02 = a.xy * a.yz - b11 * a.xz;
+		T half_det = (b00 * c00 - a.xy * c01 + a.xz * c02) / (p * p * p) * T(0.5);
+		if (half_det < T(-1)) half_det = T(-1);
+		if (half_det > T(1)) half_det = T(1);
+
+		const T angle = T(acos(half_det)) / T(3);
+		const T beta2 = T(2) * T(cos(angle));
+		const T beta0 = T(2) * T(cos(angle + T(2.0943951023931955)));
+		const T beta1 = -(beta0 + beta2);
+		const T values[3] = { q + p * beta0, q + p * beta1, q + p * beta2 };
+
+		// start from the eigenvalue farthest from the other two
+		vec3<T> vectors[3];
+		if (half_det >= T(0))
+		{
+			vectors[2] = detail::ShiftedRowsNull(a, values[2]);
+			detail::ComplementEigenvectors(a, vectors[2], vectors[1], vectors[0]);
+			vectors[0] = vec3<T>::CrossProduct(vectors[1], vectors[2]);
+		}
+		else
+		{
+			vectors[0] = detail::ShiftedRowsNull(a, values[0]);
+			detail::ComplementEigenvectors(a, vectors[0], vectors[2], vectors[1]);
+			vectors[2] = vec3<T>::CrossProduct(vectors[0], vectors[1]);
+		}
+
+		// Rayleigh quotients, their error is quadratic in the vectors' one
+		T refined[3];
+		for (unsigned int i = 0; i < 3; i++)
+			refined[i] = vec3<T>::DotProduct(vectors[i], detail::Multiply(a, vectors[i]));
+		for (unsigned int i = 0; i < 2; i++)
+		{
+			for (unsigned int j = 0; j < 2 - i; j++)
+			{
+				if (refined[j + 1] < refined[j])
+				{
+					const T value = refined[j]; refined[j] = refined[j + 1]; refined[j + 1] = value;
+					const vec3<T> vector = vectors[j]; vectors[j] = vectors[j + 1]; vectors[j + 1] = -vector;
+				}
+			}
+		}
+
+		result.values = vec3<T>(refined[0] * largest, refined[1] * largest, refined[2] * largest);
+		result.vectors[0] = vectors[0];
+		result.vectors[1] = vectors[1];
+		result.vectors[2] = vectors[2];
+		return result;
+	}
+	template <typename T> void EigenSymmetric(const symmetric3<T>* matrices, eigen3<T>* results, size_t count)
+	{
+		ParallelFor(count, reduction_grain / 16u, [matrices, results](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+					results[i] = EigenSymmetric(matrices[i]);
+			});
+	}
+
+	// covariance of a point set, divided by count
+	template <typename T> symmetric3<T> Covariance(const vec3<T>* points, size_t count)
+	{
+		if (count == 0u) return symmetric3<T>();
+
+		const vec3<T> mean = Mean(points, count);
+		symmetric3<T> sum = ParallelReduce(count, reduction_grain, symmetric3<T>(),
+			[points, &mean](size_t begin, size_t end)
+			{
+				symmetric3<T> s;
+				for (size_t i = begin; i < end; i++)
+				{
+					const vec3<T> d = points[i] - mean;
+					s.xx += d.x * d.x; s.yy += d.y * d.y; s.zz += d.z * d.z;
+					s.xy += d.x * d.y; s.xz += d.x * d.z; s.yz += d.y * d.z;
+				}
+				return s;
+			},
+			[](const symmetric3<T>& a, const symmetric3<T>& b)
+			{
+				return symmetric3<T>(a.xx + b.xx, a.yy + b.yy, a.zz + b.zz, a.xy + b.xy, a.xz + b.xz, a.yz + b.yz);
+			});
+
+		const T r_count = T(1) / T(count);
+		return symmetric3<T>(sum.xx * r_count, sum.yy * r_count, sum.zz * r_count,
+			sum.xy * r_count, sum.xz * r_count, sum.yz * r_count);
+	}
+	// principal axes of a point set, largest variance last
+	template <typename T> eigen3<T> PrincipalAxes(const vec3<T>* points, size_t count)
+	{
+		return EigenSymmetric(Covariance(points, count));
+	}
+
+
+	namespace detail
+	{
+		// W lanes of row-major 3x3 matrices, element e of lane l at [e][l]
+		template <typename T, unsigned int W> struct svd_lanes
+		{
+			T s[9][W];	// A^T A, rotated towards diagonal
+			T v[9][W];
+			T b[9][W];	// A V, then R of its QR
+			T u[9][W];
+		};
+
+		// sweeps after which A^T A is diagonal to working precision
+		template <typename T> constexpr unsigned int JacobiSweeps()
+		{
+			return sizeof(T) <= 4u ? 4u : 6u;
+		}
+
+		// one Jacobi rotation zeroing s[p][q], accumulated into v
+		template <unsigned int p, unsigned int q, typename T, unsigned int W>
+		void JacobiRotate(svd_lanes<T, W>& m)
+		{
+			const unsigned int r = 3u - p - q;
+			for (unsigned int l = 0; l < W; l++)
+			{
+				const T spp = m.s[p * 3 + p][l], sqq = m.s[q * 3 + q][l], spq = m.s[p * 3 + q][l];
+				const T srp = m.s[r * 3 + p][l], srq = m.s[r * 3 + q][l];
+
+				const bool rotate = spq != T(0);
+				const T tau = (sqq - spp) / (T(2) * (rotate ? spq : T(1)));
+				const T abs_tau = tau < T(0) ? -tau : tau;
+				const T t_abs = T(1) / (abs_tau + T(sqrt(T(1) + tau * tau)));
+				const T t = rotate ? (tau < T(0) ? -t_abs : t_abs) : T(0);
+				const T c = T(1) / T(sqrt(T(1) + t * t));
+				const T s = t * c;
+
+				m.s[p * 3 + p][l] = spp - t * spq;
+				m.s[q * 3 + q][l] = sqq + t * spq;
+				m.s[p * 3 + q][l] = T(0);
+				m.s[q * 3 + p][l] = T(0);
+				const T rp = c * srp - s * srq;
+				const T rq = s * srp + c * srq;
+				m.s[r * 3 + p][l] = rp;
+				m.s[p * 3 + r][l] = rp;
+				m.s[r * 3 + q][l] = rq;
+				m.s[q * 3 + r][l] = rq;
+
+				for (unsigned int k = 0; k < 3; k++)
+				{
+					const T vkp = m.v[k * 3 + p][l], vkq = m.v[k * 3 + q][l];
+					m.v[k * 3 + p][l] = c * vkp - s * vkq;
+					m.v[k * 3 + q][l] = s * vkp + c * vkq;
+				}
+			}
+		}
+
+		// puts the longer of columns i < j of b first, negating the moved
+		// column so v stays a rotation
+		template <unsigned int i, unsigned int j, typename T, unsigned int W>
+		void SortColumns(svd_lanes<T, W>& m)
+		{
+			for (unsigned int l = 0; l < W; l++)
+			{
+				const T ni = m.b[i][l] * m.b[i][l] + m.b[3 + i][l] * m.b[3 + i][l] + m.b[6 + i][l] * m.b[6 + i][l];
+				const T nj = m.b[j][l] * m.b[j][l] + m.b[3 + j][l] * m.b[3 + j][l] + m.b[6 + j][l] * m.b[6 + j][l];
+				const bool swap = nj > ni;
+				for (unsigned int k = 0; k < 3; k++)
+				{
+					const T bi = m.b[k * 3 + i][l], bj = m.b[k * 3 + j][l];
+					m.b[k * 3 + i][l] = swap ? bj : bi;
+					m.b[k * 3 + j][l] = swap ? -bi : bj;
+					const T vi = m.v[k * 3 + i][l], vj = m.v[k * 3 + j][l];
+					m.v[k * 3 + i][l] = swap ? vj : vi;
+					m.v[k * 3 + j][l] = swap ? -vi : vj;
+				}
+			}
+		}
+
+		// Givens rotation of rows c and r of b zeroing b[r][c], its
+		// transpose accumulated into the columns of u
+		template <unsigned int r, unsigned int c, typename T, unsigned int W>
+		void GivensQR(svd_lanes<T, W>& m)
+		{
+			for (unsigned int l = 0; l < W; l++)
+			{
+				const T a = m.b[c * 3 + c][l], b = m.b[r * 3 + c][l];
+				const T rho2 = a * a + b * b;
+				const bool rotate = rho2 > T(0);
+				const T r_rho = T(1) / T(sqrt(rotate ? rho2 : T(1)));
+				const T cs = rotate ? a * r_rho : T(1);
+				const T sn = rotate ? b * r_rho : T(0);
+
+				for (unsigned int k = 0; k < 3; k++)
+				{
+					const T bc = m.b[c * 3 + k][l], br = m.b[r * 3 + k][l];
+					m.b[c * 3 + k][l] = cs * bc + sn * br;
+					m.b[r * 3 + k][l] = cs * br - sn * bc;
+					const T uc = m.u[k * 3 + c][l], ur = m.u[k * 3 + r][l];
+					m.u[k * 3 + c][l] = cs * uc + sn * ur;
+					m.u[k * 3 + r][l] = cs * ur - sn * uc;
+				}
+			}
+		}
+
+		// full decomposition of the W matrices of one batch block
+		template <typename T, unsigned int W> void SvdBlock(const T* a, svd_lanes<T, W>& m)
+		{
+			for (unsigned int l = 0; l < W; l++)
+			{
+				for (unsigned int i = 0; i < 3; i++)
+					for (unsigned int j = 0; j < 3; j++)
+					{
+						m.s[i * 3 + j][l] =
+							a[(0 * 3 + i) * W + l] * a[(0 * 3 + j) * W + l] +
+							a[(1 * 3 + i) * W + l] * a[(1 * 3 + j) * W + l] +
+							a[(2 * 3 + i) * W + l] * a[(2 * 3 + j) * W + l];
+						m.v[i * 3 + j][l] = i == j ? T(1) : T(0);
+						m.u[i * 3 + j][l] = i == j ? T(1) : T(0);
+					}
+			}
+			for (unsigned int sweep = 0; sweep < JacobiSweeps<T>(); sweep++)
+			{
+				JacobiRotate<0, 1>(m);
+				JacobiRotate<0, 2>(m);
+				JacobiRotate<1, 2>(m);
+			}
+
+			for (unsigned int l = 0; l < W; l++)
+			{
+				for (unsigned int i = 0; i < 3; i++)
+					for (unsigned int j = 0; j < 3; j++)
+					{
+						m.b[i * 3 + j][l] =
+							a[(i * 3 + 0) * W + l] * m.v[0 * 3 + j][l] +
+							a[(i * 3 + 1) * W + l] * m.v[1 * 3 + j][l] +
+							a[(i * 3 + 2) * W + l] * m.v[2 * 3 + j][l];
+					}
+			}
+			SortColumns<0, 1>(m);
+			SortColumns<0, 2>(m);
+			SortColumns<1, 2>(m);
+
+			GivensQR<1, 0>(m);
+			GivensQR<2, 0>(m);
+			GivensQR<2, 1>(m);
+		}
+	}
+
+
+	// decomposes every matrix of A, results has A.GetCount() entries
+	template <typename T, unsigned int W> void Svd(const matrix_batch<T, 3, W>& A, svd3<T>* results)
+	{
+		const size_t count = A.GetCount();
+		ParallelFor(A.GetBlockCount(), detail::batch_grain / 8u,
+			[&A, results, count](size_t begin, size_t end)
+			{
+				detail::svd_lanes<T, W> m;
+				for (size_t block = begin; block < end; block++)
+				{
+					detail::SvdBlock<T, W>(A.Block(block), m);
+
+					const size_t first = block * W;
+					const unsigned int n = (count - first < W) ? unsigned(count - first) : W;
+					for (unsigned int l = 0; l < n; l++)
+					{
+						svd3<T>& r = results[first + l];
+						for (unsigned int j = 0; j < 3; j++)
+						{
+							r.u[j] = vec3<T>(m.u[j][l], m.u[3 + j][l], m.u[6 + j][l]);
+							r.v[j] = vec3<T>(m.v[j][l], m.v[3 + j][l], m.v[6 + j][l]);
+						}
+						r.values = vec3<T>(m.b[0][l], m.b[4][l], m.b[8][l]);
+					}
+				}
+			});
+	}
+
+	// A = R S with R the closest rotation to A and S symmetric, through
+	// the decomposition above (R = U V^T, S = V diag V^T)
+	template <typename T, unsigned int W>
+	void Polar(const matrix_batch<T, 3, W>& A, matrix_batch<T, 3, W>& R, matrix_batch<T, 3, W>& S)
+	{
+		if (R.GetCount() != A.GetCount()) R.Resize(A.GetCount());
+		if (S.GetCount() != A.GetCount()) S.Resize(A.GetCount());
+
+		ParallelFor(A.GetBlockCount(), detail::batch_grain / 8u,
+			[&A, &R, &S](size_t begin, size_t end)
+			{
+				detail::svd_lanes<T, W> m;
+				for (size_t block = begin; block < end; block++)
+				{
+					detail::SvdBlock<T, W>(A.Block(block), m);
+
+					T* r = R.Block(block);
+					T* s = S.Block(block);
+					for (unsigned int l = 0; l < W; l++)
+					{
+						const T sigma[3] = { m.b[0][l], m.b[4][l], m.b[8][l] };
+						for (unsigned int i = 0; i < 3; i++)
+							for (unsigned int j = 0; j < 3; j++)
+							{
+								T rotation = T(0), stretch = T(0);
+								for (unsigned int k = 0; k < 3; k++)
+								{
+									rotation += m.u[i * 3 + k][l] * m.v[j * 3 + k][l];
+									stretch += m.v[i * 3 + k][l] * sigma[k] * m.v[j * 3 + k][l];
+								}
+								r[(i * 3 + j) * W + l] = rotation;
+								s[(i * 3 + j) * W + l] = stretch;
+							}
+					}
+				}
+			});
+	}
+}
+
+#endif // !DECOMPOSITION3_H
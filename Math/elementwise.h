@@ -0,0 +1,207 @@
+#ifndef ELEMENTWISE_H
+#define ELEMENTWISE_H
+
+#include "Matrix.h"
+#include "parallel.h"
+
+#include <stddef.h>
+
+namespace Math
+{
+	// Element-wise kernels over matrix<T>. Each one is a single flat pass
+	// over the contiguous storage (row by row when an operand has a
+	// leading dimension wider than its rows), with the operation inlined
+	// into the loop so the compiler vectorizes it, and large matrices are
+	// split into fixed chunks over the shared pool. Fusing forms like Y = a X + Y or
+	// Z = X o Y + B into one kernel reads every operand once instead of
+	// once per operator.
+	//
+	// Inputs must have equal dimensions, otherwise nothing is written and
+	// false is returned. Result is reshaped when its dimensions differ and
+	// may be one of the inputs.
+
+	constexpr size_t elementwise_grain = 1u << 16;
+
+	namespace detail
+	{
+		template <typename T> bool SameShape(const matrix<T>& M1, const matrix<T>& M2)
+		{
+			return M1.GetRows() == M2.GetRows() && M1.GetColumns() == M2.GetColumns();
+		}
+		template <typename T> void Reshape(matrix<T>& Result, const matrix<T>& M)
+		{
+			if (!SameShape(Result, M))
+				Result = matrix<T>(M.GetRows(), M.GetColumns(), M.DefaultValue());
+		}
+
+		// loop bodies run over [begin, end) of the flat storage
+		template <typename Kernel> void ElementwisePass(size_t count, const Kernel& kernel)
+		{
+			if (count <= elementwise_grain) kernel(size_t(0), count);
+			else ParallelFor(count, elementwise_grain, kernel);
+		}
+		// run(i, j, n) handles n elements from row i, column j on; with
+		// contiguous operands j runs past the row end over the flat storage
+		template <typename Run> void ElementwiseRuns(size_t rows, size_t columns, bool contiguous, const Run& run)
+		{
+			if (contiguous)
+			{
+				ElementwisePass(rows * columns, [&run](size_t begin, size_t end) { run(size_t(0), begin, end - begin); });
+				return;
+			}
+			const size_t grain = columns < elementwise_grain ? elementwise_grain / columns : 1u;
+			const auto row_range = [&run, columns](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+					run(i, size_t(0), columns);
+			};
+			if (rows <= grain) row_range(size_t(0), rows);
+			else ParallelFor(rows, grain, row_range);
+		}
+	}
+
+
+	// Result = f(X)
+	template <typename T, typename F> bool Map(const matrix<T>& X, matrix<T>& Result, F f)
+	{
+		detail::Reshape(Result, X);
+		const T* x = X.Data();
+		T* r = Result.Data();
+		const size_t ldx = X.LeadingDimension(), ldr = Result.LeadingDimension();
+		detail::ElementwiseRuns(X.GetRows(), X.GetColumns(), X.IsContiguous() && Result.IsContiguous(),
+			[x, r, ldx, ldr, &f](size_t i, size_t j, size_t n)
+			{
+				const T* xi = x + i * ldx + j;
+				T* ri = r + i * ldr + j;
+				for (size_t k = 0; k < n; k++)
+					ri[k] = f(xi[k]);
+			});
+		return true;
+	}
+	template <typename T, typename F> matrix<T> Map(const matrix<T>& X, F f)
+	{
+		matrix<T> Result(X.GetRows(), X.GetColumns(), X.DefaultValue());
+		Map(X, Result, f);
+		return Result;
+	}
+	// X = f(X)
+	template <typename T, typename F> void MapInPlace(matrix<T>& X, F f)
+	{
+		Map(X, X, f);
+	}
+
+	// Result = f(X, Y)
+	template <typename T, typename F> bool Zip(const matrix<T>& X, const matrix<T>& Y, matrix<T>& Result, F f)
+	{
+		if (!detail::SameShape(X, Y))
+			return false;
+
+		detail::Reshape(Result, X);
+		const T* x = X.Data();
+		const T* y = Y.Data();
+		T* r = Result.Data();
+		const size_t ldx = X.LeadingDimension(), ldy = Y.LeadingDimension(), ldr = Result.LeadingDimension();
+		detail::ElementwiseRuns(X.GetRows(), X.GetColumns(), X.IsContiguous() && Y.IsContiguous() && Result.IsContiguous(),
+			[x, y, r, ldx, ldy, ldr, &f](size_t i, size_t j, size_t n)
+			{
+				const T* xi = x + i * ldx + j;
+				const T* yi = y + i * ldy + j;
+				T* ri = r + i * ldr + j;
+				for (size_t k = 0; k < n; k++)
+					ri[k] = f(xi[k], yi[k]);
+			});
+		return true;
+	}
+	template <typename T, typename F> matrix<T> Zip(const matrix<T>& X, const matrix<T>& Y, F f)
+	{
+		matrix<T> Result(X.GetRows(), X.GetColumns(), X.DefaultValue());
+		if (!Zip(X, Y, Result, f))
+			return X;
+		return Result;
+	}
+
+	// Result = f(X, Y, Z)
+	template <typename T, typename F> bool Zip3(const matrix<T>& X, const matrix<T>& Y, const matrix<T>& Z, matrix<T>& Result, F f)
+	{
+		if (!detail::SameShape(X, Y) || !detail::SameShape(X, Z))
+			return false;
+
+		detail::Reshape(Result, X);
+		const T* x = X.Data();
+		const T* y = Y.Data();
+		const T* z = Z.Data();
+		T* r = Result.Data();
+		const size_t ldx = X.LeadingDimension(), ldy = Y.LeadingDimension();
+		const size_t ldz = Z.LeadingDimension(), ldr = Result.LeadingDimension();
+		detail::ElementwiseRuns(X.GetRows(), X.GetColumns(),
+			X.IsContiguous() && Y.IsContiguous() && Z.IsContiguous() && Result.IsContiguous(),
+			[x, y, z, r, ldx, ldy, ldz, ldr, &f](size_t i, size_t j, size_t n)
+			{
+				const T* xi = x + i * ldx + j;
+				const T* yi = y + i * ldy + j;
+				const T* zi = z + i * ldz + j;
+				T* ri = r + i * ldr + j;
+				for (size_t k = 0; k < n; k++)
+					ri[k] = f(xi[k], yi[k], zi[k]);
+			});
+		return true;
+	}
+	template <typename T, typename F> matrix<T> Zip3(const matrix<T>& X, const matrix<T>& Y, const matrix<T>& Z, F f)
+	{
+		matrix<T> Result(X.GetRows(), X.GetColumns(), X.DefaultValue());
+		if (!Zip3(X, Y, Z, Result, f))
+			return X;
+		return Result;
+	}
+
+
+	// X = a X
+	template <typename T> void Scale(matrix<T>& X, T a)
+	{
+		MapInPlace(X, [a](const T& x) { return a * x; });
+	}
+	// Y = a X + Y
+	template <typename T> bool Axpy(T a, const matrix<T>& X, matrix<T>& Y)
+	{
+		if (!detail::SameShape(X, Y))
+			return false;
+		return Zip(X, Y, Y, [a](const T& x, const T& y) { return a * x + y; });
+	}
+	// Y = a X + b Y
+	template <typename T> bool Axpby(T a, const matrix<T>& X, T b, matrix<T>& Y)
+	{
+		if (!detail::SameShape(X, Y))
+			return false;
+		return Zip(X, Y, Y, [a, b](const T& x, const T& y) { return a * x + b * y; });
+	}
+	// Result = a X + Y
+	template <typename T> bool Axpy(T a, const matrix<T>& X, const matrix<T>& Y, matrix<T>& Result)
+	{
+		return Zip(X, Y, Result, [a](const T& x, const T& y) { return a * x + y; });
+	}
+
+	// Result = X o Y + B, o the Hadamard product
+	template <typename T> bool MultiplyAdd(const matrix<T>& X, const matrix<T>& Y, const matrix<T>& B, matrix<T>& Result)
+	{
+		return Zip3(X, Y, B, Result, [](const T& x, const T& y, const T& b) { return x * y + b; });
+	}
+	template <typename T> matrix<T> MultiplyAdd(const matrix<T>& X, const matrix<T>& Y, const matrix<T>& B)
+	{
+		matrix<T> Result(X.GetRows(), X.GetColumns(), X.DefaultValue());
+		if (!MultiplyAdd(X, Y, B, Result))
+			return X;
+		return Result;
+	}
+	// Result = X o Y + b
+	template <typename T> bool MultiplyAdd(const matrix<T>& X, const matrix<T>& Y, T b, matrix<T>& Result)
+	{
+		return Zip(X, Y, Result, [b](const T& x, const T& y) { return x * y + b; });
+	}
+	// Result = a X + b, one pass for scale and offset
+	template <typename T> bool MultiplyAdd(T a, const matrix<T>& X, T b, matrix<T>& Result)
+	{
+		return Map(X, Result, [a, b](const T& x) { return a * x + b; });
+	}
+}
+
+#endif // !ELEMENTWISE_H
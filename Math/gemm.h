@@ -0,0 +1,102 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+#include "Matrix.h"
+#include "parallel.h"
+
+#include <stddef.h>
+
+namespace Math
+{
+	namespace detail
+	{
+		constexpr size_t gemm_block_rows = 64u;
+		constexpr size_t gemm_block_columns = 512u;
+		constexpr size_t gemm_block_depth = 256u;
+		constexpr size_t gemm_parallel_threshold = 1u << 18;	// multiply-adds
+
+		// rows [i_begin, i_end) of C on the calling thread, without the
+		// pool or any allocation
+		template <typename T>
+		void GemmRows(size_t i_begin, size_t i_end, size_t n, size_t k,
+			const T* a, size_t lda,
+			const T* b, size_t ldb,
+			T* c, size_t ldc,
+			bool accumulate)
+		{
+			if (!accumulate)
+			{
+				for (size_t i = i_begin; i < i_end; i++)
+					for (size_t j = 0; j < n; j++)
+						c[i * ldc + j] = T(0);
+			}
+
+			for (size_t j0 = 0; j0 < n; j0 += gemm_block_columns)
+			{
+				const size_t nc = (n - j0 < gemm_block_columns) ? n - j0 : gemm_block_columns;
+				for (size_t k0 = 0; k0 < k; k0 += gemm_block_depth)
+				{
+					const size_t kc = (k - k0 < gemm_block_depth) ? k - k0 : gemm_block_depth;
+					for (size_t i = i_begin; i < i_end; i++)
+					{
+						T* c_row = c + i * ldc + j0;
+						const T* a_row = a + i * lda + k0;
+						for (size_t p = 0; p < kc; p++)
+						{
+							const T a_ip = a_row[p];
+							const T* b_row = b + (k0 + p) * ldb + j0;
+							for (size_t j = 0; j < nc; j++)
+							{
+								c_row[j] += a_ip * b_row[j];
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	// C = A * B, or C += A * B when accumulate is set. All operands are
+	// row-major with leading dimensions (elements between rows), A is
+	// m x k, B is k x n and C is m x n; C must not alias A or B.
+	// Blocked i-k-j loops keep a tile of B in cache and the innermost loop
+	// runs over contiguous rows, row blocks are split across the pool.
+	template <typename T>
+	void Gemm(size_t m, size_t n, size_t k,
+		const T* a, size_t lda,
+		const T* b, size_t ldb,
+		T* c, size_t ldc,
+		bool accumulate = false)
+	{
+		if (m == 0 || n == 0) return;
+
+		const size_t block_rows = detail::gemm_block_rows;
+		const size_t row_blocks = (m + block_rows - 1) / block_rows;
+		const size_t grain = (m * n * k < detail::gemm_parallel_threshold) ? row_blocks : 1;
+
+		ParallelFor(row_blocks, grain,
+			[=](size_t block_begin, size_t block_end)
+			{
+				const size_t i_begin = block_begin * block_rows;
+				const size_t i_end = (block_end * block_rows < m) ? block_end * block_rows : m;
+				detail::GemmRows(i_begin, i_end, n, k, a, lda, b, ldb, c, ldc, accumulate);
+			});
+	}
+	// Result = M1 * M2 into an existing matrix of matching size, returns
+	// false (Result untouched) when the dimensions don't fit
+	template <typename T>
+	bool Gemm(const matrix<T>& M1, const matrix<T>& M2, matrix<T>& Result)
+	{
+		if (M1.GetColumns() != M2.GetRows() ||
+			Result.GetRows() != M1.GetRows() || Result.GetColumns() != M2.GetColumns())
+			return false;
+
+		Gemm<T>(M1.GetRows(), M2.GetColumns(), M1.GetColumns(),
+			M1.Data(), M1.LeadingDimension(),
+			M2.Data(), M2.LeadingDimension(),
+			Result.Data(), Result.LeadingDimension());
+		return true;
+	}
+}
+
+#endif // !GEMM_H
\ No newline at end of file
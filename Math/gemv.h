@@ -0,0 +1,188 @@
+#ifndef GEMV_H
+#define GEMV_H
+
+#include "Matrix.h"
+#include "parallel.h"
+#include "vec3.h"
+
+#include <stddef.h>
+
+namespace Math
+{
+	namespace detail
+	{
+		constexpr size_t gemv_parallel_threshold = 1u << 16;	// matrix elements
+		constexpr size_t gemv_column_block = 1024u;
+		constexpr size_t transform_grain = 8192u;
+
+		template <typename T> T RowDot(const T* row, const T* x, size_t n)
+		{
+			T acc[4] = { T(0), T(0), T(0), T(0) };
+			size_t k = 0;
+			for (; k + 4 <= n; k += 4)
+			{
+				acc[0] += row[k] * x[k];
+				acc[1] += row[k + 1] * x[k + 1];
+				acc[2] += row[k + 2] * x[k + 2];
+				acc[3] += row[k + 3] * x[k + 3];
+			}
+			for (; k < n; k++)
+			{
+				acc[0] += row[k] * x[k];
+			}
+			return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+		}
+	}
+
+
+	// y = alpha * A * x + beta * y, A row-major rows x columns with rows
+	// lda elements apart
+	template <typename T>
+	void Gemv(const T* a, size_t rows, size_t columns, size_t lda, const T* x, T* y, T alpha = T(1), T beta = T(0))
+	{
+		const size_t grain = (rows * columns < detail::gemv_parallel_threshold)
+			? rows : (detail::gemv_parallel_threshold + columns - 1) / columns;
+
+		ParallelFor(rows, grain,
+			[=](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					const T dot = detail::RowDot(a + i * lda, x, columns);
+					y[i] = (beta == T(0)) ? alpha * dot : alpha * dot + beta * y[i];
+				}
+			});
+	}
+	template <typename T>
+	void Gemv(const T* a, size_t rows, size_t columns, const T* x, T* y, T alpha = T(1), T beta = T(0))
+	{
+		Gemv(a, rows, columns, columns, x, y, alpha, beta);
+	}
+	// y = alpha * A^T * x + beta * y, streams A row by row so no strided
+	// access is needed; each task owns a block of columns of y
+	template <typename T>
+	void GemvTransposed(const T* a, size_t rows, size_t columns, size_t lda, const T* x, T* y, T alpha = T(1), T beta = T(0))
+	{
+		const size_t grain = (rows * columns < detail::gemv_parallel_threshold)
+			? columns : detail::gemv_column_block;
+
+		ParallelFor(columns, grain,
+			[=](size_t begin, size_t end)
+			{
+				T* y_block = y + begin;
+				const size_t n = end - begin;
+				for (size_t j = 0; j < n; j++)
+				{
+					y_block[j] = (beta == T(0)) ? T(0) : beta * y_block[j];
+				}
+				for (size_t i = 0; i < rows; i++)
+				{
+					const T s = alpha * x[i];
+					const T* a_row = a + i * lda + begin;
+					for (size_t j = 0; j < n; j++)
+					{
+						y_block[j] += s * a_row[j];
+					}
+				}
+			});
+	}
+	template <typename T>
+	void GemvTransposed(const T* a, size_t rows, size_t columns, const T* x, T* y, T alpha = T(1), T beta = T(0))
+	{
+		GemvTransposed(a, rows, columns, columns, x, y, alpha, beta);
+	}
+	// matrix overloads, x has GetColumns() (GetRows() when transposed) elements
+	template <typename T>
+	void Gemv(const matrix<T>& M, const T* x, T* y, T alpha = T(1), T beta = T(0))
+	{
+		Gemv(M.Data(), M.GetRows(), M.GetColumns(), M.LeadingDimension(), x, y, alpha, beta);
+	}
+	template <typename T>
+	void GemvTransposed(const matrix<T>& M, const T* x, T* y, T alpha = T(1), T beta = T(0))
+	{
+		GemvTransposed(M.Data(), M.GetRows(), M.GetColumns(), M.LeadingDimension(), x, y, alpha, beta);
+	}
+
+
+	// Transforms count points by M straight from the vec3 array:
+	// 3x3 - linear, out = M * p
+	// 3x4 - affine, out = M * [p, 1]
+	// 4x4 - projective, out = (M * [p, 1]).xyz / w
+	// Other shapes leave out untouched. in and out may alias.
+	template <typename T>
+	void TransformPoints(const matrix<T>& M, const vec3<T>* in, vec3<T>* out, size_t count, bool parallel = true)
+	{
+		const unsigned int rows = M.GetRows();
+		const unsigned int columns = M.GetColumns();
+		if (!((rows == 3 && columns == 3) || (rows == 3 && columns == 4) || (rows == 4 && columns == 4)))
+			return;
+
+		// coefficients of a 4x4 with the missing parts of the identity
+		T m[16] = { T(0) };
+		m[15] = T(1);
+		for (unsigned int i = 0; i < rows; i++)
+			for (unsigned int j = 0; j < columns; j++)
+				m[i * 4 + j] = M.Value(i, j);
+
+		const bool projective = (rows == 4);
+		const size_t grain = parallel ? detail::transform_grain : count;
+		ParallelFor(count, grain,
+			[=](size_t begin, size_t end)
+			{
+				const T m00 = m[0], m01 = m[1], m02 = m[2], m03 = m[3];
+				const T m10 = m[4], m11 = m[5], m12 = m[6], m13 = m[7];
+				const T m20 = m[8], m21 = m[9], m22 = m[10], m23 = m[11];
+				const T m30 = m[12], m31 = m[13], m32 = m[14], m33 = m[15];
+
+				if (projective)
+				{
+					for (size_t i = begin; i < end; i++)
+					{
+						const T x = in[i].x, y = in[i].y, z = in[i].z;
+						const T r_w = T(1) / (m30 * x + m31 * y + m32 * z + m33);
+						out[i].x = (m00 * x + m01 * y + m02 * z + m03) * r_w;
+						out[i].y = (m10 * x + m11 * y + m12 * z + m13) * r_w;
+						out[i].z = (m20 * x + m21 * y + m22 * z + m23) * r_w;
+					}
+				}
+				else
+				{
+					for (size_t i = begin; i < end; i++)
+					{
+						const T x = in[i].x, y = in[i].y, z = in[i].z;
+						out[i].x = m00 * x + m01 * y + m02 * z + m03;
+						out[i].y = m10 * x + m11 * y + m12 * z + m13;
+						out[i].z = m20 * x + m21 * y + m22 * z + m23;
+					}
+				}
+			});
+	}
+	// as TransformPoints but ignores translation and the projective row
+	template <typename T>
+	void TransformDirections(const matrix<T>& M, const vec3<T>* in, vec3<T>* out, size_t count, bool parallel = true)
+	{
+		const unsigned int rows = M.GetRows();
+		const unsigned int columns = M.GetColumns();
+		if (rows < 3 || rows > 4 || columns < 3 || columns > 4 || (rows == 4 && columns == 3))
+			return;
+
+		const T m00 = M.Value(0, 0), m01 = M.Value(0, 1), m02 = M.Value(0, 2);
+		const T m10 = M.Value(1, 0), m11 = M.Value(1, 1), m12 = M.Value(1, 2);
+		const T m20 = M.Value(2, 0), m21 = M.Value(2, 1), m22 = M.Value(2, 2);
+
+		const size_t grain = parallel ? detail::transform_grain : count;
+		ParallelFor(count, grain,
+			[=](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					const T x = in[i].x, y = in[i].y, z = in[i].z;
+					out[i].x = m00 * x + m01 * y + m02 * z;
+					out[i].y = m10 * x + m11 * y + m12 * z;
+					out[i].z = m20 * x + m21 * y + m22 * z;
+				}
+			});
+	}
+}
+
+#endif // !GEMV_H
\ No newline at end of file
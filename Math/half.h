@@ -0,0 +1,199 @@
+#ifndef HALF_H
+#define HALF_H
+
+#include <stdint.h>
+#include <string.h>	// memcpy()
+#include <stddef.h>
+
+// AVX2 doesn't imply F16C for GCC / Clang (-mf16c), MSVC has no macro for
+// it and enables it with /arch:AVX2
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#include <immintrin.h>
+#define MATH_HALF_F16C
+#endif
+
+namespace Math
+{
+	// IEEE 754 binary16, storage only - arithmetic is done in float
+	struct half
+	{
+	public:
+		uint16_t bits;
+
+	public:
+		half()
+			: bits(0u)
+		{}
+		half(float value)
+			: bits(FromFloat(value))
+		{}
+		operator float() const
+		{
+			return ToFloat(bits);
+		}
+
+		static half FromBits(uint16_t bits)
+		{
+			half h;
+			h.bits = bits;
+			return h;
+		}
+
+
+	public:
+		// round to nearest even, overflow gives infinity
+		static uint16_t FromFloat(float value)
+		{
+			uint32_t f;
+			memcpy(&f, &value, sizeof(f));
+			const uint32_t sign = (f >> 16) & 0x8000u;
+			f &= 0x7fffffffu;
+
+			if (f >= 0x47800000u)	// out of range, infinity or nan
+				return uint16_t(sign | (f > 0x7f800000u ? 0x7e00u : 0x7c00u));
+
+			if (f < 0x38800000u)	// subnormal, let the fpu do the rounding
+			{
+				float magnitude;
+				memcpy(&magnitude, &f, sizeof(f));
+				magnitude += 0.5f;
+				memcpy(&f, &magnitude, sizeof(f));
+				return uint16_t(sign | (f - 0x3f000000u));
+			}
+
+			const uint32_t mantissa_odd = (f >> 13) & 1u;
+			f += 0xc8000fffu + mantissa_odd;
+			return uint16_t(sign | (f >> 13));
+		}
+		static float ToFloat(uint16_t h)
+		{
+			const uint32_t sign = uint32_t(h & 0x8000u) << 16;
+			const uint32_t exponent = (h >> 10) & 0x1fu;
+			const uint32_t mantissa = h & 0x3ffu;
+
+			uint32_t f;
+			if (exponent == 0u)
+			{
+				const float magnitude = float(mantissa) * 5.9604644775390625e-8f;	// 2^-24
+				memcpy(&f, &magnitude, sizeof(f));
+				f |= sign;
+			}
+			else if (exponent == 0x1fu)
+			{
+				f = sign | 0x7f800000u | (mantissa << 13);
+			}
+			else
+			{
+				f = sign | ((exponent + 112u) << 23) | (mantissa << 13);
+			}
+
+			float value;
+			memcpy(&value, &f, sizeof(f));
+			return value;
+		}
+	};
+
+	// upper half of a binary32, same range as float with 8 bit mantissa
+	struct bfloat16
+	{
+	public:
+		uint16_t bits;
+
+	public:
+		bfloat16()
+			: bits(0u)
+		{}
+		bfloat16(float value)
+			: bits(FromFloat(value))
+		{}
+		operator float() const
+		{
+			return ToFloat(bits);
+		}
+
+		static bfloat16 FromBits(uint16_t bits)
+		{
+			bfloat16 b;
+			b.bits = bits;
+			return b;
+		}
+
+
+	public:
+		// round to nearest even, nan stays quiet nan; branch free so
+		// the bulk loops below vectorize
+		static uint16_t FromFloat(float value)
+		{
+			uint32_t f;
+			memcpy(&f, &value, sizeof(f));
+			const uint32_t rounded = (f + 0x7fffu + ((f >> 16) & 1u)) >> 16;
+			const uint32_t quiet_nan = (f >> 16) | 0x40u;
+			return uint16_t((f & 0x7fffffffu) > 0x7f800000u ? quiet_nan : rounded);
+		}
+		static float ToFloat(uint16_t b)
+		{
+			const uint32_t f = uint32_t(b) << 16;
+			float value;
+			memcpy(&value, &f, sizeof(f));
+			return value;
+		}
+	};
+
+
+	// bulk conversions
+	inline void ConvertToFloat(const half* source, float* destination, size_t count)
+	{
+		size_t i = 0;
+#ifdef MATH_HALF_F16C
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+			_mm256_storeu_ps(destination + i, _mm256_cvtph_ps(h));
+		}
+#endif
+		for (; i < count; i++)
+		{
+			destination[i] = half::ToFloat(source[i].bits);
+		}
+	}
+	inline void ConvertFromFloat(const float* source, half* destination, size_t count)
+	{
+		size_t i = 0;
+#ifdef MATH_HALF_F16C
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(source + i), _MM_FROUND_TO_NEAREST_INT);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), h);
+		}
+#endif
+		for (; i < count; i++)
+		{
+			destination[i].bits = half::FromFloat(source[i]);
+		}
+	}
+	inline void ConvertToFloat(const bfloat16* source, float* destination, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			destination[i] = bfloat16::ToFloat(source[i].bits);
+		}
+	}
+	inline void ConvertFromFloat(const float* source, bfloat16* destination, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			destination[i].bits = bfloat16::FromFloat(source[i]);
+		}
+	}
+	// float to float, lets kernels treat every storage type uniformly
+	inline void ConvertToFloat(const float* source, float* destination, size_t count)
+	{
+		if (source != destination) memcpy(destination, source, count * sizeof(float));
+	}
+	inline void ConvertFromFloat(const float* source, float* destination, size_t count)
+	{
+		if (source != destination) memcpy(destination, source, count * sizeof(float));
+	}
+}
+
+#endif // !HALF_H
\ No newline at end of file
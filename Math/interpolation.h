@@ -0,0 +1,202 @@
+#ifndef INTERPOLATION_H
+#define INTERPOLATION_H
+
+#include "parallel.h"
+#include "vec3.h"
+
+#include <math.h>	// sqrt()
+#include <stddef.h>
+
+namespace Math
+{
+	// Bulk interpolation of vec3 keys. Each kernel evaluates its basis
+	// weights from the parameter and blends the components directly into
+	// the caller's output, without vec3 temporaries or allocation, so the
+	// per-component loops vectorize. The parameter is either one value
+	// shared by all elements or an array with one value per element.
+	// Outputs may alias any input of the same index.
+
+	namespace detail
+	{
+		constexpr size_t interpolation_grain = 16384u;
+
+		template <typename T> struct shared_parameter
+		{
+			T t;
+			T operator[](size_t) const
+			{
+				return t;
+			}
+		};
+		template <typename T> struct element_parameter
+		{
+			const T* t;
+			T operator[](size_t i) const
+			{
+				return t[i];
+			}
+		};
+
+		template <typename T> struct linear_basis
+		{
+			static void Weights(T t, T* w)
+			{
+				w[0] = T(1) - t;
+				w[1] = t;
+			}
+		};
+		template <typename T> struct bezier_basis
+		{
+			static void Weights(T t, T* w)
+			{
+				const T s = T(1) - t;
+				w[0] = s * s * s;
+				w[1] = T(3) * t * s * s;
+				w[2] = T(3) * t * t * s;
+				w[3] = t * t * t;
+			}
+		};
+		// applied to (p0, m0, p1, m1)
+		template <typename T> struct hermite_basis
+		{
+			static void Weights(T t, T* w)
+			{
+				const T t2 = t * t, t3 = t2 * t;
+				w[0] = T(2) * t3 - T(3) * t2 + T(1);
+				w[1] = t3 - T(2) * t2 + t;
+				w[2] = T(3) * t2 - T(2) * t3;
+				w[3] = t3 - t2;
+			}
+		};
+		// uniform Catmull-Rom between p1 and p2
+		template <typename T> struct catmull_rom_basis
+		{
+			static void Weights(T t, T* w)
+			{
+				const T t2 = t * t, t3 = t2 * t;
+				w[0] = T(0.5) * (-t3 + T(2) * t2 - t);
+				w[1] = T(0.5) * (T(3) * t3 - T(5) * t2 + T(2));
+				w[2] = T(0.5) * (T(-3) * t3 + T(4) * t2 + t);
+				w[3] = T(0.5) * (t3 - t2);
+			}
+		};
+
+		template <typename Basis, typename T, typename P>
+		void Blend2(const vec3<T>* a, const vec3<T>* b, const P& t, size_t count, vec3<T>* out)
+		{
+			ParallelFor(count, interpolation_grain, [a, b, t, out](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; i++)
+					{
+						T w[2];
+						Basis::Weights(t[i], w);
+						const T x = w[0] * a[i].x + w[1] * b[i].x;
+						const T y = w[0] * a[i].y + w[1] * b[i].y;
+						const T z = w[0] * a[i].z + w[1] * b[i].z;
+						out[i].x = x;
+						out[i].y = y;
+						out[i].z = z;
+					}
+				});
+		}
+		template <typename Basis, typename T, typename P>
+		void Blend4(const vec3<T>* p0, const vec3<T>* p1, const vec3<T>* p2, const vec3<T>* p3,
+			const P& t, size_t count, vec3<T>* out)
+		{
+			ParallelFor(count, interpolation_grain, [p0, p1, p2, p3, t, out](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; i++)
+					{
+						T w[4];
+						Basis::Weights(t[i], w);
+						const T x = w[0] * p0[i].x + w[1] * p1[i].x + w[2] * p2[i].x + w[3] * p3[i].x;
+						const T y = w[0] * p0[i].y + w[1] * p1[i].y + w[2] * p2[i].y + w[3] * p3[i].y;
+						const T z = w[0] * p0[i].z + w[1] * p1[i].z + w[2] * p2[i].z + w[3] * p3[i].z;
+						out[i].x = x;
+						out[i].y = y;
+						out[i].z = z;
+					}
+				});
+		}
+
+		// lerp then normalize, zero length results stay zero
+		template <typename T, typename P>
+		void NormalizedBlend(const vec3<T>* a, const vec3<T>* b, const P& t, size_t count, vec3<T>* out)
+		{
+			ParallelFor(count, interpolation_grain, [a, b, t, out](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; i++)
+					{
+						const T s = T(1) - t[i];
+						const T x = s * a[i].x + t[i] * b[i].x;
+						const T y = s * a[i].y + t[i] * b[i].y;
+						const T z = s * a[i].z + t[i] * b[i].z;
+						const T length_squared = x * x + y * y + z * z;
+						const T inv = length_squared > T(0) ? T(1) / T(sqrt(length_squared)) : T(0);
+						out[i].x = x * inv;
+						out[i].y = y * inv;
+						out[i].z = z * inv;
+					}
+				});
+		}
+	}
+
+
+	// (1 - t) a + t b, exact at both ends
+	template <typename T> void Lerp(const vec3<T>* a, const vec3<T>* b, const T* t, size_t count, vec3<T>* out)
+	{
+		detail::Blend2<detail::linear_basis<T>>(a, b, detail::element_parameter<T>{ t }, count, out);
+	}
+	template <typename T> void Lerp(const vec3<T>* a, const vec3<T>* b, T t, size_t count, vec3<T>* out)
+	{
+		detail::Blend2<detail::linear_basis<T>>(a, b, detail::shared_parameter<T>{ t }, count, out);
+	}
+
+	// lerp of unit vectors renormalized, the cheap stand-in for slerp
+	template <typename T> void Nlerp(const vec3<T>* a, const vec3<T>* b, const T* t, size_t count, vec3<T>* out)
+	{
+		detail::NormalizedBlend(a, b, detail::element_parameter<T>{ t }, count, out);
+	}
+	template <typename T> void Nlerp(const vec3<T>* a, const vec3<T>* b, T t, size_t count, vec3<T>* out)
+	{
+		detail::NormalizedBlend(a, b, detail::shared_parameter<T>{ t }, count, out);
+	}
+
+	// cubic Bezier with control points p0..p3
+	template <typename T> void Bezier(const vec3<T>* p0, const vec3<T>* p1, const vec3<T>* p2, const vec3<T>* p3,
+		const T* t, size_t count, vec3<T>* out)
+	{
+		detail::Blend4<detail::bezier_basis<T>>(p0, p1, p2, p3, detail::element_parameter<T>{ t }, count, out);
+	}
+	template <typename T> void Bezier(const vec3<T>* p0, const vec3<T>* p1, const vec3<T>* p2, const vec3<T>* p3,
+		T t, size_t count, vec3<T>* out)
+	{
+		detail::Blend4<detail::bezier_basis<T>>(p0, p1, p2, p3, detail::shared_parameter<T>{ t }, count, out);
+	}
+
+	// cubic Hermite from p0 with tangent m0 to p1 with tangent m1
+	template <typename T> void Hermite(const vec3<T>* p0, const vec3<T>* m0, const vec3<T>* p1, const vec3<T>* m1,
+		const T* t, size_t count, vec3<T>* out)
+	{
+		detail::Blend4<detail::hermite_basis<T>>(p0, m0, p1, m1, detail::element_parameter<T>{ t }, count, out);
+	}
+	template <typename T> void Hermite(const vec3<T>* p0, const vec3<T>* m0, const vec3<T>* p1, const vec3<T>* m1,
+		T t, size_t count, vec3<T>* out)
+	{
+		detail::Blend4<detail::hermite_basis<T>>(p0, m0, p1, m1, detail::shared_parameter<T>{ t }, count, out);
+	}
+
+	// uniform Catmull-Rom segment from p1 to p2
+	template <typename T> void CatmullRom(const vec3<T>* p0, const vec3<T>* p1, const vec3<T>* p2, const vec3<T>* p3,
+		const T* t, size_t count, vec3<T>* out)
+	{
+		detail::Blend4<detail::catmull_rom_basis<T>>(p0, p1, p2, p3, detail::element_parameter<T>{ t }, count, out);
+	}
+	template <typename T> void CatmullRom(const vec3<T>* p0, const vec3<T>* p1, const vec3<T>* p2, const vec3<T>* p3,
+		T t, size_t count, vec3<T>* out)
+	{
+		detail::Blend4<detail::catmull_rom_basis<T>>(p0, p1, p2, p3, detail::shared_parameter<T>{ t }, count, out);
+	}
+}
+
+#endif // !INTERPOLATION_H
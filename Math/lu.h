@@ -0,0 +1,90 @@
+#ifndef LU_H
+#define LU_H
+
+#include "Matrix.h"
+
+#include <math.h>	// fabs()
+#include <stddef.h>
+#include <vector>
+
+namespace Math
+{
+	// In place LU decomposition with partial pivoting, PA = LU. L (unit
+	// diagonal, not stored) and U share the storage of M, pivots[i] is
+	// the row swapped with row i at step i. Returns false for non square
+	// or singular matrices, M then holds the partial factorization.
+	template <typename T> bool LUDecompose(matrix<T>& M, std::vector<size_t>& pivots)
+	{
+		const size_t n = M.GetRows();
+		if (n != M.GetColumns())
+			return false;
+
+		T* a = M.Data();
+		const size_t lda = M.LeadingDimension();
+		pivots.resize(n);
+		for (size_t k = 0; k < n; k++)
+		{
+			size_t pivot = k;
+			for (size_t i = k + 1; i < n; i++)
+			{
+				if (fabs(a[i * lda + k]) > fabs(a[pivot * lda + k]))
+					pivot = i;
+			}
+			pivots[k] = pivot;
+			if (a[pivot * lda + k] == T(0))
+				return false;
+
+			if (pivot != k)
+			{
+				for (size_t j = 0; j < n; j++)
+				{
+					const T temp = a[k * lda + j];
+					a[k * lda + j] = a[pivot * lda + j];
+					a[pivot * lda + j] = temp;
+				}
+			}
+
+			const T r_pivot = T(1) / a[k * lda + k];
+			for (size_t i = k + 1; i < n; i++)
+			{
+				const T l = a[i * lda + k] * r_pivot;
+				a[i * lda + k] = l;
+				for (size_t j = k + 1; j < n; j++)
+				{
+					a[i * lda + j] -= l * a[k * lda + j];
+				}
+			}
+		}
+		return true;
+	}
+	// solves A x = b in place of b using the factorization of LUDecompose
+	template <typename T> void LUSolve(const matrix<T>& LU, const std::vector<size_t>& pivots, T* b)
+	{
+		const size_t n = LU.GetRows();
+		const T* a = LU.Data();
+		const size_t lda = LU.LeadingDimension();
+
+		for (size_t k = 0; k < n; k++)
+		{
+			if (pivots[k] != k)
+			{
+				const T temp = b[k];
+				b[k] = b[pivots[k]];
+				b[pivots[k]] = temp;
+			}
+		}
+		for (size_t i = 1; i < n; i++)
+		{
+			for (size_t j = 0; j < i; j++)
+				b[i] -= a[i * lda + j] * b[j];
+		}
+		for (size_t i = n; i-- > 0;)
+		{
+			for (size_t j = i + 1; j < n; j++)
+				b[i] -= a[i * lda + j] * b[j];
+			b[i] /= a[i * lda + i];
+		}
+	}
+}
+
+#endif // !LU_H
\ No newline at end of file
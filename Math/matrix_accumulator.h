@@ -0,0 +1,224 @@
+#ifndef MATRIX_ACCUMULATOR_H
+#define MATRIX_ACCUMULATOR_H
+
+#include "Matrix.h"
+#include "parallel.h"
+
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace Math
+{
+	// Scatter-add into a rows x columns matrix from many tasks without
+	// locks or atomics. Every slot owns a private copy of the matrix,
+	// split into 64 x 64 tiles that are allocated and zeroed on first
+	// touch, so localized updates (splats, histograms of clustered data)
+	// cost memory only where they land and at most slots full copies.
+	//
+	// Merging reduces each tile over the slots that touched it in a fixed
+	// pairwise tree (slot 0 + 1, 2 + 3, then the pairs, ...), tiles in
+	// parallel. With a fixed slot count and contributions assigned to
+	// slots deterministically, as Scatter does, the sums are bitwise
+	// reproducible regardless of scheduling.
+	template <typename T> class matrix_accumulator
+	{
+	private:
+		static constexpr unsigned int tile_shift = 6u;
+		static constexpr unsigned int tile_size = 1u << tile_shift;
+		static constexpr unsigned int tile_mask = tile_size - 1u;
+		static constexpr size_t tile_elements = size_t(tile_size) * tile_size;
+
+
+	public:
+		// private tiles of one slot, used by one task at a time
+		class slot
+		{
+		private:
+			size_t tile_columns;
+			std::vector<std::unique_ptr<T[]>> tiles;
+			std::vector<uint8_t> touched;
+
+			friend class matrix_accumulator<T>;
+
+
+		public:
+			slot(size_t tile_rows, size_t tile_columns)
+				: tile_columns(tile_columns)
+				, tiles(tile_rows * tile_columns)
+				, touched(tile_rows * tile_columns, 0u)
+			{}
+
+
+		public:
+			void Add(unsigned int row, unsigned int column, const T& value)
+			{
+				At(row, column) += value;
+			}
+			// running sum of this slot at (row, column)
+			T& At(unsigned int row, unsigned int column)
+			{
+				T* tile = Touch((row >> tile_shift) * tile_columns + (column >> tile_shift));
+				return tile[((row & tile_mask) << tile_shift) | (column & tile_mask)];
+			}
+
+
+		private:
+			T* Touch(size_t t)
+			{
+				if (!touched[t])
+				{
+					if (!tiles[t]) tiles[t].reset(new T[tile_elements]);
+					T* tile = tiles[t].get();
+					for (size_t i = 0; i < tile_elements; i++)
+						tile[i] = T(0);
+					touched[t] = 1u;
+				}
+				return tiles[t].get();
+			}
+		};
+
+
+	private:
+		unsigned int rows, columns;
+		size_t tile_rows, tile_columns;
+		std::vector<std::unique_ptr<slot>> slots;
+
+
+	public:
+		// slots defaults to one per pool thread plus the caller
+		matrix_accumulator(unsigned int rows, unsigned int columns, unsigned int slot_count = 0u)
+			: rows(rows)
+			, columns(columns)
+			, tile_rows((size_t(rows) + tile_mask) >> tile_shift)
+			, tile_columns((size_t(columns) + tile_mask) >> tile_shift)
+		{
+			if (slot_count == 0u) slot_count = thread_pool::Shared().GetThreadCount() + 1u;
+			slots.resize(slot_count);
+		}
+		matrix_accumulator(const matrix_accumulator&) = delete;
+		matrix_accumulator& operator=(const matrix_accumulator&) = delete;
+
+
+	public:
+		unsigned int GetSlotCount() const
+		{
+			return unsigned(slots.size());
+		}
+		// for callers running their own threads, one thread per index
+		slot& Slot(unsigned int index)
+		{
+			if (!slots[index]) slots[index].reset(new slot(tile_rows, tile_columns));
+			return *slots[index];
+		}
+
+		// calls f(slot, begin, end) on the pool, [0, count) split into one
+		// contiguous range per slot
+		template <typename F> void Scatter(size_t count, const F& f)
+		{
+			const size_t n = slots.size();
+			for (size_t s = 0; s < n; s++)
+				Slot(unsigned(s));
+
+			ParallelFor(n, 1u, [this, count, n, &f](size_t begin, size_t end)
+				{
+					for (size_t s = begin; s < end; s++)
+					{
+						const size_t first = count * s / n, last = count * (s + 1) / n;
+						if (first < last) f(*slots[s], first, last);
+					}
+				});
+		}
+
+		// tiles touched by any slot, a measure of the memory in use
+		size_t TouchedTiles() const
+		{
+			size_t total = 0u;
+			for (const std::unique_ptr<slot>& s : slots)
+			{
+				if (!s) continue;
+				for (uint8_t t : s->touched)
+					total += t;
+			}
+			return total;
+		}
+
+		// Target += sum of all slots, false when the shapes differ. The
+		// contributions are consumed, the tiles stay allocated for reuse.
+		bool MergeInto(matrix<T>& Target)
+		{
+			if (Target.GetRows() != rows || Target.GetColumns() != columns)
+				return false;
+
+			T* target = Target.Data();
+			const size_t ld = Target.LeadingDimension();
+			ParallelFor(tile_rows * tile_columns, 1u, [this, target, ld](size_t begin, size_t end)
+				{
+					std::vector<T*> sources;
+					for (size_t t = begin; t < end; t++)
+					{
+						sources.clear();
+						for (const std::unique_ptr<slot>& s : slots)
+						{
+							if (s && s->touched[t])
+							{
+								sources.push_back(s->tiles[t].get());
+								s->touched[t] = 0u;
+							}
+						}
+						if (sources.empty()) continue;
+
+						const size_t n = sources.size();
+						for (size_t stride = 1u; stride < n; stride <<= 1)
+						{
+							for (size_t k = 0; k + stride < n; k += stride << 1)
+							{
+								T* a = sources[k];
+								const T* b = sources[k + stride];
+								for (size_t i = 0; i < tile_elements; i++)
+									a[i] += b[i];
+							}
+						}
+
+						const size_t i0 = (t / tile_columns) << tile_shift, j0 = (t % tile_columns) << tile_shift;
+						const size_t ni = (rows - i0 < tile_size) ? rows - i0 : tile_size;
+						const size_t nj = (columns - j0 < tile_size) ? columns - j0 : tile_size;
+						const T* sum = sources[0];
+						for (size_t i = 0; i < ni; i++)
+						{
+							T* row = target + (i0 + i) * ld + j0;
+							const T* tile_row = sum + (i << tile_shift);
+							for (size_t j = 0; j < nj; j++)
+								row[j] += tile_row[j];
+						}
+					}
+				});
+			return true;
+		}
+		matrix<T> Merge()
+		{
+			matrix<T> Result(rows, columns);
+			MergeInto(Result);
+			return Result;
+		}
+
+		// drops contributions, release_memory frees the tiles as well
+		void Clear(bool release_memory = false)
+		{
+			for (std::unique_ptr<slot>& s : slots)
+			{
+				if (!s) continue;
+				if (release_memory)
+				{
+					s.reset();
+					continue;
+				}
+				for (uint8_t& t : s->touched)
+					t = 0u;
+			}
+		}
+	};
+}
+
+#endif // !MATRIX_ACCUMULATOR_H
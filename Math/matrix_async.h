@@ -0,0 +1,369 @@
+#ifndef MATRIX_ASYNC_H
+#define MATRIX_ASYNC_H
+
+#include "gemm.h"
+#include "lu.h"
+#include "Matrix.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <future>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Math
+{
+	namespace detail
+	{
+		struct async_task
+		{
+			std::function<void()> work;
+			thread_pool* pool = nullptr;
+
+			// one extra count holds the task back while it is being submitted
+			std::atomic<size_t> pending{ 1 };
+			std::mutex mutex;
+			bool done = false;
+			std::vector<std::shared_ptr<async_task>> successors;
+			// thrown by the task or by one it waited for; set before it
+			// runs, the work is skipped and the error passed on
+			std::exception_ptr error;
+
+			std::promise<void> promise;
+			std::shared_future<void> future;
+		};
+
+		inline void ReleaseTask(const std::shared_ptr<async_task>& task);
+
+		inline void RunTask(const std::shared_ptr<async_task>& task)
+		{
+			std::exception_ptr error;
+			{
+				std::lock_guard<std::mutex> lock(task->mutex);
+				error = task->error;
+			}
+			if (!error)
+			{
+				try
+				{
+					task->work();
+				}
+				catch (...)
+				{
+					error = std::current_exception();
+				}
+			}
+			task->work = nullptr;
+
+			std::vector<std::shared_ptr<async_task>> successors;
+			{
+				std::lock_guard<std::mutex> lock(task->mutex);
+				task->done = true;
+				task->error = error;
+				successors.swap(task->successors);
+			}
+			if (error) task->promise.set_exception(error);
+			else task->promise.set_value();
+
+			for (const std::shared_ptr<async_task>& successor : successors)
+			{
+				if (error)
+				{
+					std::lock_guard<std::mutex> lock(successor->mutex);
+					if (!successor->error) successor->error = error;
+				}
+				ReleaseTask(successor);
+			}
+		}
+		inline void ReleaseTask(const std::shared_ptr<async_task>& task)
+		{
+			if (task->pending.fetch_sub(1) == 1)
+			{
+				std::shared_ptr<async_task> ready = task;
+				task->pool->Submit([ready]() { RunTask(ready); });
+			}
+		}
+		// after runs once before has finished
+		inline void AddDependency(const std::shared_ptr<async_task>& before, const std::shared_ptr<async_task>& after)
+		{
+			if (!before || before == after) return;
+
+			std::lock_guard<std::mutex> lock(before->mutex);
+			if (!before->done)
+			{
+				after->pending.fetch_add(1);
+				before->successors.push_back(after);
+			}
+			else if (before->error)
+			{
+				// after isn't released yet, nothing else holds its mutex
+				std::lock_guard<std::mutex> after_lock(after->mutex);
+				if (!after->error) after->error = before->error;
+			}
+		}
+	}
+
+
+	// completion handle of a submitted operation
+	class task_handle
+	{
+	private:
+		std::shared_ptr<detail::async_task> task;
+
+		template <typename T> friend class matrix_queue;
+
+	public:
+		task_handle()
+		{}
+		explicit task_handle(const std::shared_ptr<detail::async_task>& task)
+			: task(task)
+		{}
+
+
+	public:
+		bool IsValid() const
+		{
+			return task != nullptr;
+		}
+		bool IsDone() const
+		{
+			if (!task) return true;
+			std::lock_guard<std::mutex> lock(task->mutex);
+			return task->done;
+		}
+		// blocks until the operation finished; don't call it from inside
+		// a task, the pool thread would be lost to waiting
+		void Wait() const
+		{
+			if (task) task->future.wait();
+		}
+		// rethrows an exception thrown by the operation
+		std::shared_future<void> GetFuture() const
+		{
+			return task ? task->future : std::shared_future<void>();
+		}
+	};
+
+
+	// Runs matrix operations as tasks on a thread pool. Dependencies are
+	// inferred from the matrices each operation reads and writes (read
+	// after write, write after read and write after write are ordered,
+	// independent operations run concurrently) and can be given
+	// explicitly as handles. Every call returns at once, operands must
+	// stay alive and untouched by the caller until their tasks are done.
+	// An operation that throws fails its handle's future, and everything
+	// ordered after it fails with the same exception without running.
+	template <typename T> class matrix_queue
+	{
+	private:
+		struct resource_state
+		{
+			std::shared_ptr<detail::async_task> writer;
+			std::vector<std::shared_ptr<detail::async_task>> readers;
+			size_t prune_readers_at = 32u;
+		};
+
+		thread_pool& pool;
+		std::mutex mutex;
+		std::unordered_map<const void*, resource_state> resources;
+		size_t sweep_resources_at = 256u;
+		std::vector<std::shared_ptr<detail::async_task>> submitted;
+
+
+	private:
+		// finished, nothing later has to be ordered after it; failed
+		// tasks are kept unless forgotten, so their error reaches later
+		// tasks
+		static bool IsRetired(const std::shared_ptr<detail::async_task>& task, bool forget_failed)
+		{
+			std::lock_guard<std::mutex> lock(task->mutex);
+			return task->done && (forget_failed || !task->error);
+		}
+		static void PruneRetired(std::vector<std::shared_ptr<detail::async_task>>& tasks, bool forget_failed = false)
+		{
+			size_t kept = 0u;
+			for (size_t i = 0; i < tasks.size(); i++)
+			{
+				if (!IsRetired(tasks[i], forget_failed)) tasks[kept++] = std::move(tasks[i]);
+			}
+			tasks.resize(kept);
+		}
+		// drops retired tasks and the entries of resources left idle
+		void SweepResources(bool forget_failed = false)
+		{
+			for (auto it = resources.begin(); it != resources.end();)
+			{
+				resource_state& state = it->second;
+				PruneRetired(state.readers, forget_failed);
+				if (state.writer && IsRetired(state.writer, forget_failed)) state.writer.reset();
+				if (!state.writer && state.readers.empty()) it = resources.erase(it);
+				else ++it;
+			}
+		}
+
+
+	public:
+		explicit matrix_queue(thread_pool& pool = thread_pool::Shared())
+			: pool(pool)
+		{}
+		matrix_queue(const matrix_queue&) = delete;
+		matrix_queue& operator=(const matrix_queue&) = delete;
+		~matrix_queue()
+		{
+			WaitAll();
+		}
+
+
+	public:
+		// generic operation, reads and writes are the objects it touches
+		task_handle Submit(std::function<void()> work,
+			std::initializer_list<const void*> reads,
+			std::initializer_list<const void*> writes,
+			std::initializer_list<task_handle> after = {})
+		{
+			std::shared_ptr<detail::async_task> task = std::make_shared<detail::async_task>();
+			task->work = std::move(work);
+			task->pool = &pool;
+			task->future = task->promise.get_future().share();
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				for (const task_handle& handle : after)
+				{
+					detail::AddDependency(handle.task, task);
+				}
+				for (const void* resource : reads)
+				{
+					resource_state& state = resources[resource];
+					detail::AddDependency(state.writer, task);
+					// operands read over and over (weights) would keep
+					// every reader alive until the next write
+					if (state.readers.size() >= state.prune_readers_at)
+					{
+						PruneRetired(state.readers);
+						state.prune_readers_at = std::max<size_t>(32u, 2u * state.readers.size());
+					}
+					state.readers.push_back(task);
+				}
+				for (const void* resource : writes)
+				{
+					resource_state& state = resources[resource];
+					detail::AddDependency(state.writer, task);
+					for (const std::shared_ptr<detail::async_task>& reader : state.readers)
+					{
+						detail::AddDependency(reader, task);
+					}
+					state.readers.clear();
+					state.prune_readers_at = 32u;
+					state.writer = task;
+				}
+				if (resources.size() >= sweep_resources_at)
+				{
+					SweepResources();
+					sweep_resources_at = std::max<size_t>(256u, 2u * resources.size());
+				}
+				// forget finished tasks now and then so long runs stay bounded
+				if (submitted.size() >= 1024u)
+				{
+					std::vector<std::shared_ptr<detail::async_task>> running;
+					for (const std::shared_ptr<detail::async_task>& t : submitted)
+					{
+						if (!task_handle(t).IsDone()) running.push_back(t);
+					}
+					submitted.swap(running);
+				}
+				submitted.push_back(task);
+			}
+
+			detail::ReleaseTask(task);
+			return task_handle(task);
+		}
+
+		// C = A * B, fails with std::invalid_argument when the inner
+		// dimensions differ; C may be A or B
+		task_handle Multiply(const matrix<T>& A, const matrix<T>& B, matrix<T>& C, std::initializer_list<task_handle> after = {})
+		{
+			return Submit([&A, &B, &C]()
+				{
+					if (A.GetColumns() != B.GetRows())
+						throw std::invalid_argument("matrix_queue::Multiply: inner dimensions differ");
+					// Gemm overwrites C while reading A and B
+					if (&C == &A || &C == &B)
+					{
+						matrix<T> Product(A.GetRows(), B.GetColumns());
+						Gemm(A, B, Product);
+						C = std::move(Product);
+						return;
+					}
+					if (C.GetRows() != A.GetRows() || C.GetColumns() != B.GetColumns())
+						C = matrix<T>(A.GetRows(), B.GetColumns());
+					Gemm(A, B, C);
+				}, { &A, &B }, { &C }, after);
+		}
+		// C = A + B
+		task_handle Add(const matrix<T>& A, const matrix<T>& B, matrix<T>& C, std::initializer_list<task_handle> after = {})
+		{
+			return Submit([&A, &B, &C]()
+				{
+					C = matrix<T>::Add(A, B);
+				}, { &A, &B }, { &C }, after);
+		}
+		// C = A - B
+		task_handle Substract(const matrix<T>& A, const matrix<T>& B, matrix<T>& C, std::initializer_list<task_handle> after = {})
+		{
+			return Submit([&A, &B, &C]()
+				{
+					C = matrix<T>::Substract(A, B);
+				}, { &A, &B }, { &C }, after);
+		}
+		// M = M^T, fails with std::domain_error for non square external
+		// storage, see matrix::Transpose
+		task_handle Transpose(matrix<T>& M, std::initializer_list<task_handle> after = {})
+		{
+			return Submit([&M]()
+				{
+					if (!M.Transpose())
+						throw std::domain_error("matrix_queue::Transpose: non-square external storage");
+				}, {}, { &M }, after);
+		}
+		// in place LU with partial pivoting, see LUDecompose; fails with
+		// std::domain_error when M is singular or not square
+		task_handle Factorize(matrix<T>& M, std::vector<size_t>& pivots, std::initializer_list<task_handle> after = {})
+		{
+			return Submit([&M, &pivots]()
+				{
+					if (!LUDecompose(M, pivots))
+						throw std::domain_error("matrix_queue::Factorize: singular or non-square matrix");
+				}, {}, { &M, &pivots }, after);
+		}
+
+		// blocks until everything submitted so far has finished and
+		// forgets it, failures included; operations submitted meanwhile
+		// from other threads keep their ordering
+		void WaitAll()
+		{
+			std::vector<std::shared_ptr<detail::async_task>> tasks;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				tasks.swap(submitted);
+			}
+			for (const std::shared_ptr<detail::async_task>& task : tasks)
+			{
+				task->future.wait();
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			SweepResources(true);
+		}
+	};
+}
+
+#endif // !MATRIX_ASYNC_H
\ No newline at end of file
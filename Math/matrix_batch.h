@@ -0,0 +1,424 @@
+#ifndef MATRIX_BATCH_H
+#define MATRIX_BATCH_H
+
+#include "Matrix.h"
+#include "parallel.h"
+#include "vec3.h"
+
+#include <stddef.h>
+#include <type_traits>
+#include <vector>
+
+namespace Math
+{
+	// Many independent N x N matrices stored interleaved in blocks of W:
+	// element (row, column) of the matrices of one block lies in W
+	// consecutive values, so every batched kernel loops over the lanes
+	// innermost and each SIMD lane works on its own matrix. W defaults to
+	// one 256 bit register worth of T. The count is padded to a multiple
+	// of W, padding matrices are zero and take part in every operation.
+	template <typename T, unsigned int N, unsigned int W = unsigned(32u / sizeof(T))>
+	class matrix_batch
+	{
+	private:
+		size_t count;
+		std::vector<T> storage;
+
+
+	public:
+		static constexpr unsigned int size = N;
+		static constexpr unsigned int lanes = W;
+		static constexpr size_t block_size = size_t(N) * N * W;
+
+	public:
+		explicit matrix_batch(size_t count = 0u)
+			: count(count)
+			, storage(GetBlockCount() * block_size, T(0))
+		{}
+
+
+	public:
+		// matrices past new_count are dropped, shrinking inside a block
+		// zeroes the lanes that become padding
+		void Resize(size_t new_count)
+		{
+			count = new_count;
+			storage.resize(GetBlockCount() * block_size, T(0));
+
+			const size_t used = count % W;
+			if (used == 0u) return;
+			T* last = Block(GetBlockCount() - 1u);
+			for (unsigned int e = 0; e < N * N; e++)
+				for (size_t l = used; l < W; l++)
+					last[e * W + l] = T(0);
+		}
+		size_t GetCount() const
+		{
+			return count;
+		}
+		size_t GetBlockCount() const
+		{
+			return (count + W - 1) / W;
+		}
+
+		T& Value(size_t index, unsigned int row, unsigned int column)
+		{
+			return storage[(index / W) * block_size + (row * N + column) * W + index % W];
+		}
+		const T& Value(size_t index, unsigned int row, unsigned int column) const
+		{
+			return storage[(index / W) * block_size + (row * N + column) * W + index % W];
+		}
+		void Value(size_t index, unsigned int row, unsigned int column, const T& value)
+		{
+			Value(index, row, column) = value;
+		}
+
+		// copy one matrix in or out, row-major N x N values
+		void Load(size_t index, const T* values)
+		{
+			for (unsigned int e = 0; e < N * N; e++)
+				Value(index, e / N, e % N) = values[e];
+		}
+		void Store(size_t index, T* values) const
+		{
+			for (unsigned int e = 0; e < N * N; e++)
+				values[e] = Value(index, e / N, e % N);
+		}
+		void Load(size_t index, const matrix<T>& M)
+		{
+			if (M.GetRows() != N || M.GetColumns() != N) return;
+			for (unsigned int e = 0; e < N * N; e++)
+				Value(index, e / N, e % N) = M.Value(e / N, e % N);
+		}
+		void Store(size_t index, matrix<T>& M) const
+		{
+			if (M.GetRows() != N || M.GetColumns() != N) return;
+			for (unsigned int e = 0; e < N * N; e++)
+				M.Value(e / N, e % N) = Value(index, e / N, e % N);
+		}
+
+		T* Block(size_t block)
+		{
+			return storage.data() + block * block_size;
+		}
+		const T* Block(size_t block) const
+		{
+			return storage.data() + block * block_size;
+		}
+	};
+
+	typedef matrix_batch<float, 3> matrix3_batchf;
+	typedef matrix_batch<float, 4> matrix4_batchf;
+	typedef matrix_batch<double, 3> matrix3_batchd;
+	typedef matrix_batch<double, 4> matrix4_batchd;
+
+
+	namespace detail
+	{
+		constexpr size_t batch_grain = 1024u;	// blocks per task
+
+		template <typename T, unsigned int W>
+		void BatchDeterminant(const T* a, T* det, std::integral_constant<unsigned int, 3>)
+		{
+			for (unsigned int l = 0; l < W; l++)
+			{
+				const T m00 = a[0 * W + l], m01 = a[1 * W + l], m02 = a[2 * W + l];
+				const T m10 = a[3 * W + l], m11 = a[4 * W + l], m12 = a[5 * W + l];
+				const T m20 = a[6 * W + l], m21 = a[7 * W + l], m22 = a[8 * W + l];
+				det[l] = m00 * (m11 * m22 - m12 * m21)
+					- m01 * (m10 * m22 - m12 * m20)
+					+ m02 * (m10 * m21 - m11 * m20);
+			}
+		}
+		template <typename T, unsigned int W>
+		void BatchInverse(const T* a, T* r, T* det, std::integral_constant<unsigned int, 3>)
+		{
+			for (unsigned int l = 0; l < W; l++)
+			{
+				const T m00 = a[0 * W + l], m01 = a[1 * W + l], m02 = a[2 * W + l];
+				const T m10 = a[3 * W + l], m11 = a[4 * W + l], m12 = a[5 * W + l];
+				const T m20 = a[6 * W + l], m21 = a[7 * W + l], m22 = a[8 * W + l];
+
+				const T c00 = m11 * m22 - m12 * m21;
+				const T c01 = m12 * m20 - m10 * m22;
+				const T c02 = m10 * m21 - m11 * m20;
+				const T d = m00 * c00 + m01 * c01 + m02 * c02;
+				const T r_d = T(1) / d;
+
+				r[0 * W + l] = c00 * r_d;
+				r[1 * W + l] = (m02 * m21 - m01 * m22) * r_d;
+				r[2 * W + l] = (m01 * m12 - m02 * m11) * r_d;
+				r[3 * W + l] = c01 * r_d;
+				r[4 * W + l] = (m00 * m22 - m02 * m20) * r_d;
+				r[5 * W + l] = (m02 * m10 - m00 * m12) * r_d;
+				r[6 * W + l] = c02 * r_d;
+				r[7 * W + l] = (m01 * m20 - m00 * m21) * r_d;
+				r[8 * W + l] = (m00 * m11 - m01 * m10) * r_d;
+				if (det) det[l] = d;
+			}
+		}
+
+		// 4x4 through the 2x2 sub-determinants of the upper and lower halves
+		template <typename T, unsigned int W>
+		void BatchDeterminant(const T* a, T* det, std::integral_constant<unsigned int, 4>)
+		{
+			for (unsigned int l = 0; l < W; l++)
+			{
+				T m[16];
+				for (unsigned int e = 0; e < 16; e++) m[e] = a[e * W + l];
+
+				const T s0 = m[0] * m[5] - m[4] * m[1];
+				const T s1 = m[0] * m[6] - m[4] * m[2];
+				const T s2 = m[0] * m[7] - m[4] * m[3];
+				const T s3 = m[1] * m[6] - m[5] * m[2];
+				const T s4 = m[1] * m[7] - m[5] * m[3];
+				const T s5 = m[2] * m[7] - m[6] * m[3];
+				const T c5 = m[10] * m[15] - m[14] * m[11];
+				const T c4 = m[9] * m[15] - m[13] * m[11];
+				const T c3 = m[9] * m[14] - m[13] * m[10];
+				const T c2 = m[8] * m[15] - m[12] * m[11];
+				const T c1 = m[8] * m[14] - m[12] * m[10];
+				const T c0 = m[8] * m[13] - m[12] * m[9];
+				det[l] = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+			}
+		}
+		template <typename T, unsigned int W>
+		void BatchInverse(const T* a, T* r, T* det, std::integral_constant<unsigned int, 4>)
+		{
+			for (unsigned int l = 0; l < W; l++)
+			{
+				T m[16];
+				for (unsigned int e = 0; e < 16; e++) m[e] = a[e * W + l];
+
+				const T s0 = m[0] * m[5] - m[4] * m[1];
+				const T s1 = m[0] * m[6] - m[4] * m[2];
+				const T s2 = m[0] * m[7] - m[4] * m[3];
+				const T s3 = m[1] * m[6] - m[5] * m[2];
+				const T s4 = m[1] * m[7] - m[5] * m[3];
+				const T s5 = m[2] * m[7] - m[6] * m[3];
+				const T c5 = m[10] * m[15] - m[14] * m[11];
+				const T c4 = m[9] * m[15] - m[13] * m[11];
+				const T c3 = m[9] * m[14] - m[13] * m[10];
+				const T c2 = m[8] * m[15] - m[12] * m[11];
+				const T c1 = m[8] * m[14] - m[12] * m[10];
+				const T c0 = m[8] * m[13] - m[12] * m[9];
+
+				const T d = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+				const T r_d = T(1) / d;
+
+				r[0 * W + l] = (m[5] * c5 - m[6] * c4 + m[7] * c3) * r_d;
+				r[1 * W + l] = (-m[1] * c5 + m[2] * c4 - m[3] * c3) * r_d;
+				r[2 * W + l] = (m[13] * s5 - m[14] * s4 + m[15] * s3) * r_d;
+				r[3 * W + l] = (-m[9] * s5 + m[10] * s4 - m[11] * s3) * r_d;
+
+				r[4 * W + l] = (-m[4] * c5 + m[6] * c2 - m[7] * c1) * r_d;
+				r[5 * W + l] = (m[0] * c5 - m[2] * c2 + m[3] * c1) * r_d;
+				r[6 * W + l] = (-m[12] * s5 + m[14] * s2 - m[15] * s1) * r_d;
+				r[7 * W + l] = (m[8] * s5 - m[10] * s2 + m[11] * s1) * r_d;
+
+				r[8 * W + l] = (m[4] * c4 - m[5] * c2 + m[7] * c0) * r_d;
+				r[9 * W + l] = (-m[0] * c4 + m[1] * c2 - m[3] * c0) * r_d;
+				r[10 * W + l] = (m[12] * s4 - m[13] * s2 + m[15] * s0) * r_d;
+				r[11 * W + l] = (-m[8] * s4 + m[9] * s2 - m[11] * s0) * r_d;
+
+				r[12 * W + l] = (-m[4] * c3 + m[5] * c1 - m[6] * c0) * r_d;
+				r[13 * W + l] = (m[0] * c3 - m[1] * c1 + m[2] * c0) * r_d;
+				r[14 * W + l] = (-m[12] * s3 + m[13] * s1 - m[14] * s0) * r_d;
+				r[15 * W + l] = (m[8] * s3 - m[9] * s1 + m[10] * s0) * r_d;
+				if (det) det[l] = d;
+			}
+		}
+	}
+
+
+	// C[i] = A[i] * B[i]; C may not alias A or B. Returns false (C
+	// untouched) when A and B hold different counts.
+	template <typename T, unsigned int N, unsigned int W>
+	bool Multiply(const matrix_batch<T, N, W>& A, const matrix_batch<T, N, W>& B, matrix_batch<T, N, W>& C)
+	{
+		if (A.GetCount() != B.GetCount()) return false;
+		if (C.GetCount() != A.GetCount()) C.Resize(A.GetCount());
+
+		ParallelFor(A.GetBlockCount(), detail::batch_grain,
+			[&A, &B, &C](size_t begin, size_t end)
+			{
+				for (size_t block = begin; block < end; block++)
+				{
+					const T* a = A.Block(block);
+					const T* b = B.Block(block);
+					T* c = C.Block(block);
+					for (unsigned int r = 0; r < N; r++)
+					{
+						for (unsigned int col = 0; col < N; col++)
+						{
+							T acc[W];
+							for (unsigned int l = 0; l < W; l++) acc[l] = T(0);
+							for (unsigned int k = 0; k < N; k++)
+							{
+								const T* a_rk = a + (r * N + k) * W;
+								const T* b_kc = b + (k * N + col) * W;
+								for (unsigned int l = 0; l < W; l++)
+									acc[l] += a_rk[l] * b_kc[l];
+							}
+							for (unsigned int l = 0; l < W; l++)
+								c[(r * N + col) * W + l] = acc[l];
+						}
+					}
+				}
+			});
+		return true;
+	}
+	// R[i] = A[i]^T, R may alias A
+	template <typename T, unsigned int N, unsigned int W>
+	void Transpose(const matrix_batch<T, N, W>& A, matrix_batch<T, N, W>& R)
+	{
+		if (R.GetCount() != A.GetCount()) R.Resize(A.GetCount());
+
+		ParallelFor(A.GetBlockCount(), detail::batch_grain,
+			[&A, &R](size_t begin, size_t end)
+			{
+				for (size_t block = begin; block < end; block++)
+				{
+					const T* a = A.Block(block);
+					T* r = R.Block(block);
+					for (unsigned int i = 0; i < N; i++)
+					{
+						for (unsigned int j = i; j < N; j++)
+						{
+							for (unsigned int l = 0; l < W; l++)
+							{
+								const T upper = a[(i * N + j) * W + l];
+								const T lower = a[(j * N + i) * W + l];
+								r[(i * N + j) * W + l] = lower;
+								r[(j * N + i) * W + l] = upper;
+							}
+						}
+					}
+				}
+			});
+	}
+	// determinants[i] = det(A[i]), count values (3x3 and 4x4)
+	template <typename T, unsigned int N, unsigned int W>
+	void Determinant(const matrix_batch<T, N, W>& A, T* determinants)
+	{
+		const size_t count = A.GetCount();
+		ParallelFor(A.GetBlockCount(), detail::batch_grain,
+			[&A, determinants, count](size_t begin, size_t end)
+			{
+				T det[W];
+				for (size_t block = begin; block < end; block++)
+				{
+					detail::BatchDeterminant<T, W>(A.Block(block), det, std::integral_constant<unsigned int, N>());
+					for (unsigned int l = 0; l < W && block * W + l < count; l++)
+						determinants[block * W + l] = det[l];
+				}
+			});
+	}
+	// R[i] = A[i]^-1 by cofactors (3x3 and 4x4), R may alias A. Singular
+	// matrices give inf/nan entries, pass determinants to check them.
+	template <typename T, unsigned int N, unsigned int W>
+	void Inverse(const matrix_batch<T, N, W>& A, matrix_batch<T, N, W>& R, T* determinants = nullptr)
+	{
+		if (R.GetCount() != A.GetCount()) R.Resize(A.GetCount());
+
+		const size_t count = A.GetCount();
+		ParallelFor(A.GetBlockCount(), detail::batch_grain,
+			[&A, &R, determinants, count](size_t begin, size_t end)
+			{
+				T a[matrix_batch<T, N, W>::block_size];
+				T det[W];
+				for (size_t block = begin; block < end; block++)
+				{
+					// through a copy so R may alias A
+					const T* source = A.Block(block);
+					for (size_t e = 0; e < matrix_batch<T, N, W>::block_size; e++) a[e] = source[e];
+
+					detail::BatchInverse<T, W>(a, R.Block(block), det, std::integral_constant<unsigned int, N>());
+					if (determinants)
+					{
+						for (unsigned int l = 0; l < W && block * W + l < count; l++)
+							determinants[block * W + l] = det[l];
+					}
+				}
+			});
+	}
+	// out[i] = A[i] * in[i]; for 4x4 the point is taken as [in, 1] and
+	// divided by w. in and out may alias.
+	template <typename T, unsigned int N, unsigned int W>
+	void Apply(const matrix_batch<T, N, W>& A, const vec3<T>* in, vec3<T>* out)
+	{
+		static_assert(N == 3 || N == 4, "Apply needs 3x3 or 4x4 matrices");
+		const size_t count = A.GetCount();
+
+		ParallelFor(A.GetBlockCount(), detail::batch_grain,
+			[&A, in, out, count](size_t begin, size_t end)
+			{
+				T x[W], y[W], z[W], rx[W], ry[W], rz[W];
+				for (size_t block = begin; block < end; block++)
+				{
+					const size_t first = block * W;
+					const unsigned int n = (count - first < W) ? unsigned(count - first) : W;
+					for (unsigned int l = 0; l < W; l++)
+					{
+						const vec3<T>& p = in[first + (l < n ? l : 0)];
+						x[l] = p.x; y[l] = p.y; z[l] = p.z;
+					}
+
+					const T* m = A.Block(block);
+					for (unsigned int l = 0; l < W; l++)
+					{
+						rx[l] = m[0 * W + l] * x[l] + m[1 * W + l] * y[l] + m[2 * W + l] * z[l];
+						ry[l] = m[N * W + l] * x[l] + m[(N + 1) * W + l] * y[l] + m[(N + 2) * W + l] * z[l];
+						rz[l] = m[2 * N * W + l] * x[l] + m[(2 * N + 1) * W + l] * y[l] + m[(2 * N + 2) * W + l] * z[l];
+					}
+					if (N == 4)
+					{
+						for (unsigned int l = 0; l < W; l++)
+						{
+							const T w = m[12 * W + l] * x[l] + m[13 * W + l] * y[l] + m[14 * W + l] * z[l] + m[15 * W + l];
+							const T r_w = T(1) / w;
+							rx[l] = (rx[l] + m[3 * W + l]) * r_w;
+							ry[l] = (ry[l] + m[7 * W + l]) * r_w;
+							rz[l] = (rz[l] + m[11 * W + l]) * r_w;
+						}
+					}
+
+					for (unsigned int l = 0; l < n; l++)
+					{
+						out[first + l].x = rx[l];
+						out[first + l].y = ry[l];
+						out[first + l].z = rz[l];
+					}
+				}
+			});
+	}
+	// solves A[i] * x[i] = b[i] through the cofactor inverse (3x3), x may alias b
+	template <typename T, unsigned int W>
+	void Solve(const matrix_batch<T, 3, W>& A, const vec3<T>* b, vec3<T>* x)
+	{
+		const size_t count = A.GetCount();
+		ParallelFor(A.GetBlockCount(), detail::batch_grain,
+			[&A, b, x, count](size_t begin, size_t end)
+			{
+				T inverse[matrix_batch<T, 3, W>::block_size];
+				for (size_t block = begin; block < end; block++)
+				{
+					detail::BatchInverse<T, W>(A.Block(block), inverse, nullptr, std::integral_constant<unsigned int, 3>());
+
+					const size_t first = block * W;
+					const unsigned int n = (count - first < W) ? unsigned(count - first) : W;
+					for (unsigned int l = 0; l < n; l++)
+					{
+						const vec3<T> v = b[first + l];
+						x[first + l] = vec3<T>(
+							inverse[0 * W + l] * v.x + inverse[1 * W + l] * v.y + inverse[2 * W + l] * v.z,
+							inverse[3 * W + l] * v.x + inverse[4 * W + l] * v.y + inverse[5 * W + l] * v.z,
+							inverse[6 * W + l] * v.x + inverse[7 * W + l] * v.y + inverse[8 * W + l] * v.z);
+					}
+				}
+			});
+	}
+}
+
+#endif // !MATRIX_BATCH_H
\ No newline at end of file
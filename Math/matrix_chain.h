@@ -0,0 +1,267 @@
+#ifndef MATRIX_CHAIN_H
+#define MATRIX_CHAIN_H
+
+#include "gemm.h"
+#include "Matrix.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace Math
+{
+	// Deferred product M1 * M2 * ... * Mn. Operands are only referenced,
+	// they have to outlive Evaluate(). The parenthesization with the
+	// fewest multiply-adds is picked by the classic O(n^3) dynamic
+	// program over the operand dimensions, intermediate products live in
+	// scratch buffers which are kept across Clear() and Evaluate() calls,
+	// so a chain object reused for many products stops allocating.
+	template <typename T> class matrix_chain
+	{
+	private:
+		std::vector<const matrix<T>*> operands;
+		std::vector<uint64_t> cost;
+		std::vector<size_t> split;
+		std::vector<std::vector<T>> scratch;
+		std::vector<bool> scratch_used;
+
+		struct node
+		{
+			const T* data;
+			size_t buffer;
+			size_t ld;
+		};
+		static constexpr size_t no_buffer = ~size_t(0);
+
+
+	public:
+		matrix_chain()
+		{}
+		matrix_chain(const matrix<T>& M)
+		{
+			operands.push_back(&M);
+		}
+
+
+	public:
+		matrix_chain<T>& operator*=(const matrix<T>& M)
+		{
+			operands.push_back(&M);
+			return *this;
+		}
+		matrix_chain<T>& operator*(const matrix<T>& M)
+		{
+			return *this *= M;
+		}
+
+
+	public:
+		void Multiply(const matrix<T>& M)
+		{
+			operands.push_back(&M);
+		}
+		// forgets the operands, scratch memory is kept for the next chain
+		void Clear()
+		{
+			operands.clear();
+		}
+		size_t GetLength() const
+		{
+			return operands.size();
+		}
+		bool IsValid() const
+		{
+			if (operands.empty()) return false;
+			for (size_t i = 1; i < operands.size(); i++)
+			{
+				if (operands[i - 1]->GetColumns() != operands[i]->GetRows())
+					return false;
+			}
+			return true;
+		}
+
+		// multiply-adds of the optimal and of the left to right order
+		uint64_t Cost()
+		{
+			if (!IsValid()) return 0u;
+			Plan();
+			return cost[operands.size() - 1];	// cost[0 * n + n - 1]
+		}
+		uint64_t NaiveCost() const
+		{
+			if (!IsValid()) return 0u;
+
+			uint64_t total = 0u;
+			for (size_t i = 1; i < operands.size(); i++)
+			{
+				total += uint64_t(operands[0]->GetRows()) * operands[i]->GetRows() * operands[i]->GetColumns();
+			}
+			return total;
+		}
+
+		// Evaluates the chain, a copy of the first operand is returned when
+		// the dimensions don't match (as matrix<T>::DotProduct does)
+		matrix<T> Evaluate()
+		{
+			if (operands.empty())
+				return matrix<T>(1, 1);
+			if (!IsValid())
+				return *operands[0];
+
+			matrix<T> Result(operands.front()->GetRows(), operands.back()->GetColumns());
+			EvaluateTo(Result);
+			return Result;
+		}
+		// evaluates into Result, which must already have the final shape;
+		// Result may be one of the operands, the product is then built in
+		// a scratch buffer and copied over
+		bool EvaluateTo(matrix<T>& Result)
+		{
+			if (!IsValid() ||
+				Result.GetRows() != operands.front()->GetRows() ||
+				Result.GetColumns() != operands.back()->GetColumns())
+				return false;
+
+			if (operands.size() == 1)
+			{
+				Result = *operands[0];
+				return true;
+			}
+
+			Plan();
+			if (!IsOperand(Result))
+			{
+				Compute(0, operands.size() - 1, Result.Data(), Result.LeadingDimension());
+				return true;
+			}
+
+			const node product = Compute(0, operands.size() - 1, nullptr, 0u);
+			T* destination = Result.Data();
+			const size_t ld = Result.LeadingDimension();
+			for (size_t i = 0; i < Result.GetRows(); i++)
+			{
+				for (size_t j = 0; j < Result.GetColumns(); j++)
+				{
+					destination[i * ld + j] = product.data[i * product.ld + j];
+				}
+			}
+			ReleaseScratch(product.buffer);
+			return true;
+		}
+
+
+	private:
+		size_t Rows(size_t i) const
+		{
+			return operands[i]->GetRows();
+		}
+		size_t Columns(size_t i) const
+		{
+			return operands[i]->GetColumns();
+		}
+		// M's elements overlap those of an operand
+		bool IsOperand(const matrix<T>& M) const
+		{
+			const T* begin = M.Data();
+			const T* end = begin + (M.GetRows() - 1u) * M.LeadingDimension() + M.GetColumns();
+			for (const matrix<T>* operand : operands)
+			{
+				const T* operand_begin = operand->Data();
+				const T* operand_end = operand_begin +
+					(operand->GetRows() - 1u) * operand->LeadingDimension() + operand->GetColumns();
+				if (begin < operand_end && operand_begin < end)
+					return true;
+			}
+			return false;
+		}
+
+		// cost[i * n + j] - cheapest product of operands i..j, split[i * n + j] - its last multiplication
+		void Plan()
+		{
+			const size_t n = operands.size();
+			cost.assign(n * n, 0u);
+			split.assign(n * n, 0u);
+
+			for (size_t length = 2; length <= n; length++)
+			{
+				for (size_t i = 0; i + length <= n; i++)
+				{
+					const size_t j = i + length - 1;
+					uint64_t best = ~uint64_t(0);
+					for (size_t s = i; s < j; s++)
+					{
+						const uint64_t c = cost[i * n + s] + cost[(s + 1) * n + j] +
+							uint64_t(Rows(i)) * Columns(s) * Columns(j);
+						if (c < best)
+						{
+							best = c;
+							split[i * n + j] = s;
+						}
+					}
+					cost[i * n + j] = best;
+				}
+			}
+		}
+
+		size_t AcquireScratch(size_t size)
+		{
+			// the smallest free buffer which fits, else the largest free one grown
+			size_t fitting = no_buffer, largest = no_buffer;
+			for (size_t b = 0; b < scratch.size(); b++)
+			{
+				if (scratch_used[b]) continue;
+				if (scratch[b].size() >= size && (fitting == no_buffer || scratch[b].size() < scratch[fitting].size()))
+					fitting = b;
+				if (largest == no_buffer || scratch[b].size() > scratch[largest].size())
+					largest = b;
+			}
+
+			size_t chosen = (fitting != no_buffer) ? fitting : largest;
+			if (chosen == no_buffer)
+			{
+				scratch.emplace_back();
+				scratch_used.push_back(false);
+				chosen = scratch.size() - 1;
+			}
+			if (scratch[chosen].size() < size)
+				scratch[chosen].resize(size);
+
+			scratch_used[chosen] = true;
+			return chosen;
+		}
+		void ReleaseScratch(size_t buffer)
+		{
+			if (buffer != no_buffer)
+				scratch_used[buffer] = false;
+		}
+
+		node Compute(size_t i, size_t j, T* destination, size_t destination_ld)
+		{
+			if (i == j)
+				return node{ operands[i]->Data(), no_buffer, operands[i]->LeadingDimension() };
+
+			const size_t s = split[i * operands.size() + j];
+			const node left = Compute(i, s, nullptr, 0u);
+			const node right = Compute(s + 1, j, nullptr, 0u);
+
+			size_t buffer = no_buffer;
+			if (destination == nullptr)
+			{
+				buffer = AcquireScratch(Rows(i) * Columns(j));
+				destination = scratch[buffer].data();
+				destination_ld = Columns(j);
+			}
+
+			Gemm<T>(Rows(i), Columns(j), Columns(s),
+				left.data, left.ld,
+				right.data, right.ld,
+				destination, destination_ld);
+
+			ReleaseScratch(left.buffer);
+			ReleaseScratch(right.buffer);
+			return node{ destination, buffer, destination_ld };
+		}
+	};
+}
+
+#endif // !MATRIX_CHAIN_H
\ No newline at end of file
@@ -0,0 +1,211 @@
+#ifndef MATRIX_NARROW_H
+#define MATRIX_NARROW_H
+
+#include "half.h"
+#include "Matrix.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace Math
+{
+	// Kernels for matrix<half> and matrix<bfloat16>. Operands are read in
+	// their narrow format, converted tile by tile into float scratch that
+	// stays in cache and accumulated in float. The result type is float
+	// by default or any narrow type to keep the output small as well.
+
+	typedef matrix<half> matrix_half;
+	typedef matrix<bfloat16> matrix_bf16;
+
+	namespace detail
+	{
+		constexpr unsigned int narrow_block_rows = 64u;
+		constexpr unsigned int narrow_block_columns = 256u;
+		constexpr unsigned int narrow_block_depth = 256u;
+		constexpr size_t narrow_elementwise_grain = 1u << 16;
+	}
+
+
+	// conversion
+	template <typename Out, typename In> matrix<Out> ConvertMatrix(const matrix<In>& M)
+	{
+		matrix<Out> Result(M.GetRows(), M.GetColumns());
+		const size_t count = size_t(M.GetRows()) * M.GetColumns();
+		std::vector<In> packed;
+		const In* source = PackedData(M, packed);
+		Out* destination = Result.Data();
+
+		ParallelFor(count, detail::narrow_elementwise_grain,
+			[source, destination](size_t begin, size_t end)
+			{
+				float buffer[256];
+				for (size_t i = begin; i < end; i += 256)
+				{
+					const size_t n = (end - i < 256) ? end - i : 256;
+					ConvertToFloat(source + i, buffer, n);
+					ConvertFromFloat(buffer, destination + i, n);
+				}
+			});
+		return Result;
+	}
+	inline matrix<half> ToHalf(const matrix<float>& M)
+	{
+		return ConvertMatrix<half>(M);
+	}
+	inline matrix<bfloat16> ToBFloat16(const matrix<float>& M)
+	{
+		return ConvertMatrix<bfloat16>(M);
+	}
+	template <typename In> matrix<float> ToFloat(const matrix<In>& M)
+	{
+		return ConvertMatrix<float>(M);
+	}
+
+
+	// M1 * M2 with float accumulation, M1 returned converted when the
+	// dimensions don't match (as matrix<T>::DotProduct does)
+	template <typename Out = float, typename A, typename B>
+	matrix<Out> NarrowProduct(const matrix<A>& M1, const matrix<B>& M2)
+	{
+		if (M1.GetColumns() != M2.GetRows())
+			return ConvertMatrix<Out>(M1);
+
+		const unsigned int rows = M1.GetRows();
+		const unsigned int columns = M2.GetColumns();
+		const unsigned int depth = M1.GetColumns();
+		matrix<Out> Result(rows, columns);
+
+		std::vector<A> packed_a;
+		std::vector<B> packed_b;
+		const A* a = PackedData(M1, packed_a);
+		const B* b = PackedData(M2, packed_b);
+		Out* c = Result.Data();
+
+		const unsigned int block_rows = detail::narrow_block_rows;
+		const unsigned int block_columns = detail::narrow_block_columns;
+		const unsigned int block_depth = detail::narrow_block_depth;
+
+		ParallelFor((rows + block_rows - 1) / block_rows, 1,
+			[=](size_t block_begin, size_t block_end)
+			{
+				std::vector<float> a_tile(size_t(block_rows) * block_depth);
+				std::vector<float> b_tile(size_t(block_depth) * block_columns);
+				std::vector<float> c_tile(size_t(block_rows) * block_columns);
+
+				for (size_t block = block_begin; block < block_end; block++)
+				{
+					const unsigned int i0 = unsigned(block) * block_rows;
+					const unsigned int mc = (rows - i0 < block_rows) ? rows - i0 : block_rows;
+
+					for (unsigned int j0 = 0; j0 < columns; j0 += block_columns)
+					{
+						const unsigned int nc = (columns - j0 < block_columns) ? columns - j0 : block_columns;
+						std::fill(c_tile.begin(), c_tile.end(), 0.0f);
+
+						for (unsigned int k0 = 0; k0 < depth; k0 += block_depth)
+						{
+							const unsigned int kc = (depth - k0 < block_depth) ? depth - k0 : block_depth;
+
+							// widen the operand tiles once, reuse them mc and nc times
+							for (unsigned int i = 0; i < mc; i++)
+								ConvertToFloat(a + size_t(i0 + i) * depth + k0, &a_tile[size_t(i) * kc], kc);
+							for (unsigned int k = 0; k < kc; k++)
+								ConvertToFloat(b + size_t(k0 + k) * columns + j0, &b_tile[size_t(k) * nc], nc);
+
+							for (unsigned int i = 0; i < mc; i++)
+							{
+								float* c_row = &c_tile[size_t(i) * nc];
+								for (unsigned int k = 0; k < kc; k++)
+								{
+									const float a_ik = a_tile[size_t(i) * kc + k];
+									const float* b_row = &b_tile[size_t(k) * nc];
+									for (unsigned int j = 0; j < nc; j++)
+									{
+										c_row[j] += a_ik * b_row[j];
+									}
+								}
+							}
+						}
+
+						for (unsigned int i = 0; i < mc; i++)
+							ConvertFromFloat(&c_tile[size_t(i) * nc], c + size_t(i0 + i) * columns + j0, nc);
+					}
+				}
+			});
+		return Result;
+	}
+
+
+	namespace detail
+	{
+		// applies func(float* x, const float* y, n) over both operands widened
+		template <typename Out, typename A, typename B, typename F>
+		matrix<Out> NarrowElementwise(const matrix<A>& M1, const matrix<B>& M2, const F& func)
+		{
+			matrix<Out> Result(M1.GetRows(), M1.GetColumns());
+			const size_t count = size_t(M1.GetRows()) * M1.GetColumns();
+			std::vector<A> packed_a;
+			std::vector<B> packed_b;
+			const A* a = PackedData(M1, packed_a);
+			const B* b = PackedData(M2, packed_b);
+			Out* c = Result.Data();
+
+			ParallelFor(count, narrow_elementwise_grain,
+				[a, b, c, &func](size_t begin, size_t end)
+				{
+					float x[256], y[256];
+					for (size_t i = begin; i < end; i += 256)
+					{
+						const size_t n = (end - i < 256) ? end - i : 256;
+						ConvertToFloat(a + i, x, n);
+						ConvertToFloat(b + i, y, n);
+						func(x, y, n);
+						ConvertFromFloat(x, c + i, n);
+					}
+				});
+			return Result;
+		}
+	}
+
+	// element-wise kernels, M1 returned converted on dimension mismatch
+	template <typename Out = float, typename A, typename B>
+	matrix<Out> NarrowAdd(const matrix<A>& M1, const matrix<B>& M2)
+	{
+		if (M1.GetRows() != M2.GetRows() || M1.GetColumns() != M2.GetColumns())
+			return ConvertMatrix<Out>(M1);
+
+		return detail::NarrowElementwise<Out>(M1, M2,
+			[](float* x, const float* y, size_t n) { for (size_t i = 0; i < n; i++) x[i] += y[i]; });
+	}
+	template <typename Out = float, typename A, typename B>
+	matrix<Out> NarrowSubstract(const matrix<A>& M1, const matrix<B>& M2)
+	{
+		if (M1.GetRows() != M2.GetRows() || M1.GetColumns() != M2.GetColumns())
+			return ConvertMatrix<Out>(M1);
+
+		return detail::NarrowElementwise<Out>(M1, M2,
+			[](float* x, const float* y, size_t n) { for (size_t i = 0; i < n; i++) x[i] -= y[i]; });
+	}
+	template <typename Out = float, typename A, typename B>
+	matrix<Out> NarrowHadamardProduct(const matrix<A>& M1, const matrix<B>& M2)
+	{
+		if (M1.GetRows() != M2.GetRows() || M1.GetColumns() != M2.GetColumns())
+			return ConvertMatrix<Out>(M1);
+
+		return detail::NarrowElementwise<Out>(M1, M2,
+			[](float* x, const float* y, size_t n) { for (size_t i = 0; i < n; i++) x[i] *= y[i]; });
+	}
+	// alpha * M1 + M2
+	template <typename Out = float, typename A, typename B>
+	matrix<Out> NarrowAxpy(float alpha, const matrix<A>& M1, const matrix<B>& M2)
+	{
+		if (M1.GetRows() != M2.GetRows() || M1.GetColumns() != M2.GetColumns())
+			return ConvertMatrix<Out>(M1);
+
+		return detail::NarrowElementwise<Out>(M1, M2,
+			[alpha](float* x, const float* y, size_t n) { for (size_t i = 0; i < n; i++) x[i] = alpha * x[i] + y[i]; });
+	}
+}
+
+#endif // !MATRIX_NARROW_H
\ No newline at end of file
@@ -0,0 +1,416 @@
+#ifndef MATRIX_REDUCTION_H
+#define MATRIX_REDUCTION_H
+
+#include "Matrix.h"
+#include "parallel.h"
+#include "reduction.h"
+
+#include <cmath>	// std::sqrt()
+#include <stddef.h>
+#include <vector>
+
+namespace Math
+{
+	// Reductions of matrix<T> along rows, along columns and over the whole
+	// matrix. Row and whole reductions run over contiguous storage with
+	// four independent accumulators; column reductions stream the matrix
+	// row by row into a vector of per column accumulators, so memory is
+	// read sequentially instead of with a stride of one row. Large inputs
+	// are split into fixed blocks of rows (or elements) on the shared pool
+	// and partial results are merged in block order, so the results don't
+	// depend on the thread count.
+	//
+	// Row results are rows x 1 matrices, column results 1 x columns.
+	// Arg* functions return indices; ties keep the lowest index.
+
+	enum class vector_norm
+	{
+		l1,		// sum of magnitudes
+		l2,		// Euclidean
+		inf		// largest magnitude
+	};
+
+	namespace detail
+	{
+		template <typename T> T Magnitude(const T& x)
+		{
+			return x < T(0) ? -x : x;
+		}
+
+		// Identity(first) starts an accumulator, first is the first
+		// element it will see; Accumulate folds one element, Combine two
+		// accumulators
+		template <typename T> struct sum_reduce
+		{
+			static T Identity(const T&) { return T(0); }
+			static T Accumulate(const T& a, const T& x) { return a + x; }
+			static T Combine(const T& a, const T& b) { return a + b; }
+		};
+		template <typename T> struct magnitude_sum_reduce
+		{
+			static T Identity(const T&) { return T(0); }
+			static T Accumulate(const T& a, const T& x) { return a + Magnitude(x); }
+			static T Combine(const T& a, const T& b) { return a + b; }
+		};
+		template <typename T> struct square_sum_reduce
+		{
+			static T Identity(const T&) { return T(0); }
+			static T Accumulate(const T& a, const T& x) { return a + x * x; }
+			static T Combine(const T& a, const T& b) { return a + b; }
+		};
+		template <typename T> struct min_reduce
+		{
+			static T Identity(const T& first) { return first; }
+			static T Accumulate(const T& a, const T& x) { return x < a ? x : a; }
+			static T Combine(const T& a, const T& b) { return b < a ? b : a; }
+		};
+		template <typename T> struct max_reduce
+		{
+			static T Identity(const T& first) { return first; }
+			static T Accumulate(const T& a, const T& x) { return x > a ? x : a; }
+			static T Combine(const T& a, const T& b) { return b > a ? b : a; }
+		};
+		template <typename T> struct magnitude_max_reduce
+		{
+			static T Identity(const T&) { return T(0); }
+			static T Accumulate(const T& a, const T& x) { return Magnitude(x) > a ? Magnitude(x) : a; }
+			static T Combine(const T& a, const T& b) { return b > a ? b : a; }
+		};
+
+		template <typename T> size_t RowGrain(const matrix<T>& M)
+		{
+			const size_t columns = M.GetColumns();
+			return (columns < reduction_grain) ? reduction_grain / columns : 1u;
+		}
+
+		template <typename Op, typename T> T ReduceRange(const T* data, size_t begin, size_t end)
+		{
+			T acc[4] = { Op::Identity(data[begin]), Op::Identity(data[begin]), Op::Identity(data[begin]), Op::Identity(data[begin]) };
+			size_t i = begin;
+			for (; i + 4 <= end; i += 4)
+			{
+				acc[0] = Op::Accumulate(acc[0], data[i]);
+				acc[1] = Op::Accumulate(acc[1], data[i + 1]);
+				acc[2] = Op::Accumulate(acc[2], data[i + 2]);
+				acc[3] = Op::Accumulate(acc[3], data[i + 3]);
+			}
+			for (; i < end; i++)
+			{
+				acc[0] = Op::Accumulate(acc[0], data[i]);
+			}
+			return Op::Combine(Op::Combine(acc[0], acc[1]), Op::Combine(acc[2], acc[3]));
+		}
+
+		template <typename Op, typename T> T ReduceAll(const matrix<T>& M)
+		{
+			const T* data = M.Data();
+			if (M.IsContiguous())
+			{
+				return ParallelReduce(size_t(M.GetRows()) * M.GetColumns(), reduction_grain, Op::Identity(data[0]),
+					[data](size_t begin, size_t end) { return ReduceRange<Op>(data, begin, end); },
+					[](const T& a, const T& b) { return Op::Combine(a, b); });
+			}
+
+			// row by row over a wider leading dimension
+			const size_t columns = M.GetColumns(), ld = M.LeadingDimension();
+			return ParallelReduce(size_t(M.GetRows()), RowGrain(M), Op::Identity(data[0]),
+				[data, columns, ld](size_t begin, size_t end)
+				{
+					T acc = ReduceRange<Op>(data + begin * ld, 0, columns);
+					for (size_t i = begin + 1; i < end; i++)
+						acc = Op::Combine(acc, ReduceRange<Op>(data + i * ld, 0, columns));
+					return acc;
+				},
+				[](const T& a, const T& b) { return Op::Combine(a, b); });
+		}
+		template <typename Op, typename T> matrix<T> ReduceRows(const matrix<T>& M)
+		{
+			const size_t columns = M.GetColumns(), ld = M.LeadingDimension();
+			matrix<T> Result(M.GetRows(), 1u, M.DefaultValue());
+			const T* data = M.Data();
+			T* result = Result.Data();
+
+			ParallelFor(M.GetRows(), RowGrain(M), [data, result, columns, ld](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; i++)
+						result[i] = ReduceRange<Op>(data + i * ld, 0, columns);
+				});
+			return Result;
+		}
+		template <typename Op, typename T> matrix<T> ReduceColumns(const matrix<T>& M)
+		{
+			const size_t rows = M.GetRows(), columns = M.GetColumns(), ld = M.LeadingDimension();
+			const size_t grain = RowGrain(M);
+			const size_t blocks = (rows + grain - 1) / grain;
+			const T* data = M.Data();
+
+			// one accumulator row per block of rows
+			std::vector<T> partials(blocks * columns);
+			ParallelForChunks(rows, grain, [data, columns, ld, &partials](size_t block, size_t begin, size_t end)
+				{
+					T* acc = partials.data() + block * columns;
+					for (size_t j = 0; j < columns; j++)
+						acc[j] = Op::Identity(data[begin * ld + j]);
+					for (size_t i = begin; i < end; i++)
+					{
+						const T* row = data + i * ld;
+						for (size_t j = 0; j < columns; j++)
+							acc[j] = Op::Accumulate(acc[j], row[j]);
+					}
+				});
+
+			matrix<T> Result(1u, M.GetColumns(), M.DefaultValue());
+			T* result = Result.Data();
+			for (size_t j = 0; j < columns; j++)
+				result[j] = partials[j];
+			for (size_t b = 1; b < blocks; b++)
+			{
+				const T* acc = partials.data() + b * columns;
+				for (size_t j = 0; j < columns; j++)
+					result[j] = Op::Combine(result[j], acc[j]);
+			}
+			return Result;
+		}
+
+		template <bool Greater, typename T> bool Better(const T& candidate, const T& best)
+		{
+			return Greater ? (candidate > best) : (candidate < best);
+		}
+		template <bool Greater, typename T> size_t ArgExtremeRange(const T* data, size_t begin, size_t end)
+		{
+			size_t best = begin;
+			for (size_t i = begin + 1; i < end; i++)
+			{
+				if (Better<Greater>(data[i], data[best]))
+					best = i;
+			}
+			return best;
+		}
+		template <bool Greater, typename T> size_t ArgExtremeAll(const matrix<T>& M)
+		{
+			const T* data = M.Data();
+			if (M.IsContiguous())
+			{
+				return ParallelReduce(size_t(M.GetRows()) * M.GetColumns(), reduction_grain, size_t(0),
+					[data](size_t begin, size_t end) { return ArgExtremeRange<Greater>(data, begin, end); },
+					[data](size_t a, size_t b) { return Better<Greater>(data[b], data[a]) ? b : a; });
+			}
+
+			// row by row, still reporting flat row-major indices
+			const size_t columns = M.GetColumns(), ld = M.LeadingDimension();
+			const auto at = [data, columns, ld](size_t index) { return data[(index / columns) * ld + index % columns]; };
+			return ParallelReduce(size_t(M.GetRows()), RowGrain(M), size_t(0),
+				[data, columns, ld, &at](size_t begin, size_t end)
+				{
+					size_t best = begin * columns;
+					for (size_t i = begin; i < end; i++)
+					{
+						const size_t candidate = i * columns + ArgExtremeRange<Greater>(data + i * ld, 0, columns);
+						if (Better<Greater>(at(candidate), at(best)))
+							best = candidate;
+					}
+					return best;
+				},
+				[&at](size_t a, size_t b) { return Better<Greater>(at(b), at(a)) ? b : a; });
+		}
+		template <bool Greater, typename T> std::vector<size_t> ArgExtremeRows(const matrix<T>& M)
+		{
+			const size_t columns = M.GetColumns(), ld = M.LeadingDimension();
+			std::vector<size_t> result(M.GetRows());
+			const T* data = M.Data();
+			size_t* indices = result.data();
+
+			ParallelFor(M.GetRows(), RowGrain(M), [data, indices, columns, ld](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; i++)
+						indices[i] = ArgExtremeRange<Greater>(data + i * ld, 0, columns);
+				});
+			return result;
+		}
+		template <bool Greater, typename T> std::vector<size_t> ArgExtremeColumns(const matrix<T>& M)
+		{
+			const size_t rows = M.GetRows(), columns = M.GetColumns(), ld = M.LeadingDimension();
+			const size_t grain = RowGrain(M);
+			const size_t blocks = (rows + grain - 1) / grain;
+			const T* data = M.Data();
+
+			// best row per column and block, streamed row by row
+			std::vector<size_t> partials(blocks * columns);
+			ParallelForChunks(rows, grain, [data, columns, ld, &partials](size_t block, size_t begin, size_t end)
+				{
+					size_t* best = partials.data() + block * columns;
+					for (size_t j = 0; j < columns; j++)
+						best[j] = begin;
+					for (size_t i = begin + 1; i < end; i++)
+					{
+						const T* row = data + i * ld;
+						for (size_t j = 0; j < columns; j++)
+						{
+							if (Better<Greater>(row[j], data[best[j] * ld + j]))
+								best[j] = i;
+						}
+					}
+				});
+
+			std::vector<size_t> result(partials.begin(), partials.begin() + columns);
+			for (size_t b = 1; b < blocks; b++)
+			{
+				const size_t* best = partials.data() + b * columns;
+				for (size_t j = 0; j < columns; j++)
+				{
+					if (Better<Greater>(data[best[j] * ld + j], data[result[j] * ld + j]))
+						result[j] = best[j];
+				}
+			}
+			return result;
+		}
+
+		template <typename T> matrix<T> Sqrt(matrix<T> M)
+		{
+			T* data = M.Data();
+			for (size_t i = 0; i < size_t(M.GetRows()) * M.GetColumns(); i++)
+				data[i] = std::sqrt(data[i]);
+			return M;
+		}
+	}
+
+
+	// whole matrix
+	template <typename T> T Sum(const matrix<T>& M)
+	{
+		return detail::ReduceAll<detail::sum_reduce<T>>(M);
+	}
+	template <typename T> T Mean(const matrix<T>& M)
+	{
+		return Sum(M) / T(size_t(M.GetRows()) * M.GetColumns());
+	}
+	template <typename T> T Min(const matrix<T>& M)
+	{
+		return detail::ReduceAll<detail::min_reduce<T>>(M);
+	}
+	template <typename T> T Max(const matrix<T>& M)
+	{
+		return detail::ReduceAll<detail::max_reduce<T>>(M);
+	}
+	// flat row-major index, row = index / columns, column = index % columns
+	template <typename T> size_t ArgMin(const matrix<T>& M)
+	{
+		return detail::ArgExtremeAll<false>(M);
+	}
+	template <typename T> size_t ArgMax(const matrix<T>& M)
+	{
+		return detail::ArgExtremeAll<true>(M);
+	}
+	// sum of the diagonal, zero for non square matrices as matrix<T>::Trace
+	template <typename T> T Trace(const matrix<T>& M)
+	{
+		if (M.GetRows() != M.GetColumns())
+			return T(0);
+
+		const size_t n = M.GetColumns(), ld = M.LeadingDimension();
+		const T* data = M.Data();
+		T sum = T(0);
+		for (size_t i = 0; i < n; i++)
+			sum += data[i * ld + i];
+		return sum;
+	}
+
+	// matrix norms
+	template <typename T> T NormFrobenius(const matrix<T>& M)
+	{
+		return std::sqrt(detail::ReduceAll<detail::square_sum_reduce<T>>(M));
+	}
+	// largest element magnitude
+	template <typename T> T NormMax(const matrix<T>& M)
+	{
+		return detail::ReduceAll<detail::magnitude_max_reduce<T>>(M);
+	}
+	// induced 1-norm, largest column magnitude sum
+	template <typename T> T Norm1(const matrix<T>& M)
+	{
+		return Max(detail::ReduceColumns<detail::magnitude_sum_reduce<T>>(M));
+	}
+	// induced infinity norm, largest row magnitude sum
+	template <typename T> T NormInf(const matrix<T>& M)
+	{
+		return Max(detail::ReduceRows<detail::magnitude_sum_reduce<T>>(M));
+	}
+
+	// along rows
+	template <typename T> matrix<T> RowSums(const matrix<T>& M)
+	{
+		return detail::ReduceRows<detail::sum_reduce<T>>(M);
+	}
+	template <typename T> matrix<T> RowMeans(const matrix<T>& M)
+	{
+		matrix<T> Result = RowSums(M);
+		Result /= T(M.GetColumns());
+		return Result;
+	}
+	template <typename T> matrix<T> RowMins(const matrix<T>& M)
+	{
+		return detail::ReduceRows<detail::min_reduce<T>>(M);
+	}
+	template <typename T> matrix<T> RowMaxs(const matrix<T>& M)
+	{
+		return detail::ReduceRows<detail::max_reduce<T>>(M);
+	}
+	// column index of each row's extreme
+	template <typename T> std::vector<size_t> RowArgMins(const matrix<T>& M)
+	{
+		return detail::ArgExtremeRows<false>(M);
+	}
+	template <typename T> std::vector<size_t> RowArgMaxs(const matrix<T>& M)
+	{
+		return detail::ArgExtremeRows<true>(M);
+	}
+	template <typename T> matrix<T> RowNorms(const matrix<T>& M, vector_norm norm = vector_norm::l2)
+	{
+		switch (norm)
+		{
+			case vector_norm::l1: return detail::ReduceRows<detail::magnitude_sum_reduce<T>>(M);
+			case vector_norm::inf: return detail::ReduceRows<detail::magnitude_max_reduce<T>>(M);
+			default: return detail::Sqrt(detail::ReduceRows<detail::square_sum_reduce<T>>(M));
+		}
+	}
+
+	// along columns
+	template <typename T> matrix<T> ColumnSums(const matrix<T>& M)
+	{
+		return detail::ReduceColumns<detail::sum_reduce<T>>(M);
+	}
+	template <typename T> matrix<T> ColumnMeans(const matrix<T>& M)
+	{
+		matrix<T> Result = ColumnSums(M);
+		Result /= T(M.GetRows());
+		return Result;
+	}
+	template <typename T> matrix<T> ColumnMins(const matrix<T>& M)
+	{
+		return detail::ReduceColumns<detail::min_reduce<T>>(M);
+	}
+	template <typename T> matrix<T> ColumnMaxs(const matrix<T>& M)
+	{
+		return detail::ReduceColumns<detail::max_reduce<T>>(M);
+	}
+	// row index of each column's extreme
+	template <typename T> std::vector<size_t> ColumnArgMins(const matrix<T>& M)
+	{
+		return detail::ArgExtremeColumns<false>(M);
+	}
+	template <typename T> std::vector<size_t> ColumnArgMaxs(const matrix<T>& M)
+	{
+		return detail::ArgExtremeColumns<true>(M);
+	}
+	template <typename T> matrix<T> ColumnNorms(const matrix<T>& M, vector_norm norm = vector_norm::l2)
+	{
+		switch (norm)
+		{
+			case vector_norm::l1: return detail::ReduceColumns<detail::magnitude_sum_reduce<T>>(M);
+			case vector_norm::inf: return detail::ReduceColumns<detail::magnitude_max_reduce<T>>(M);
+			default: return detail::Sqrt(detail::ReduceColumns<detail::square_sum_reduce<T>>(M));
+		}
+	}
+}
+
+#endif // !MATRIX_REDUCTION_H
@@ -0,0 +1,242 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include "parallel.h"
+#include "vec3.h"
+
+#include <atomic>
+#include <math.h>	// sqrt()
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace Math
+{
+	// Bulk geometry of indexed triangle lists, three vertex indices per
+	// triangle into a vec3 position array.
+	//
+	// Face kernels gather the corners of a block of triangles into
+	// structure of arrays form and run the cross products, lengths and
+	// normalization as plain loops over the block, which vectorize.
+	// Vertex normals are gathered instead of scattered: a CSR list of the
+	// faces around every vertex (vertex_adjacency, reusable while the
+	// topology stays the same) lets each task sum the area weighted face
+	// normals of its own vertices, so there are no write conflicts and
+	// the faces are summed in ascending order, deterministically.
+
+	// faces[offsets[v]] .. faces[offsets[v + 1] - 1] contain vertex v
+	struct vertex_adjacency
+	{
+		std::vector<uint32_t> offsets;
+		std::vector<uint32_t> faces;
+	};
+
+	namespace detail
+	{
+		constexpr size_t mesh_block = 64u;
+		constexpr size_t mesh_grain = 16384u;
+
+		// cross products of the triangles [begin, begin + n), twice the
+		// area in length
+		template <typename T> void FaceCrossBlock(const vec3<T>* positions, const uint32_t* indices,
+			size_t begin, size_t n, T* cx, T* cy, T* cz)
+		{
+			T ex[mesh_block], ey[mesh_block], ez[mesh_block];
+			T fx[mesh_block], fy[mesh_block], fz[mesh_block];
+			for (size_t j = 0; j < n; j++)
+			{
+				const uint32_t* t = indices + 3u * (begin + j);
+				const vec3<T>& a = positions[t[0]];
+				const vec3<T>& b = positions[t[1]];
+				const vec3<T>& c = positions[t[2]];
+				ex[j] = b.x - a.x;
+				ey[j] = b.y - a.y;
+				ez[j] = b.z - a.z;
+				fx[j] = c.x - a.x;
+				fy[j] = c.y - a.y;
+				fz[j] = c.z - a.z;
+			}
+			for (size_t j = 0; j < n; j++)
+			{
+				cx[j] = ey[j] * fz[j] - ez[j] * fy[j];
+				cy[j] = ez[j] * fx[j] - ex[j] * fz[j];
+				cz[j] = ex[j] * fy[j] - ey[j] * fx[j];
+			}
+		}
+
+		template <typename T> void WeightedFaceNormals(const vec3<T>* positions, const uint32_t* indices,
+			size_t triangle_count, vec3<T>* weighted)
+		{
+			ParallelFor(triangle_count, mesh_grain, [positions, indices, weighted](size_t begin, size_t end)
+				{
+					T cx[mesh_block], cy[mesh_block], cz[mesh_block];
+					for (size_t i = begin; i < end; i += mesh_block)
+					{
+						const size_t n = (end - i < mesh_block) ? end - i : mesh_block;
+						FaceCrossBlock(positions, indices, i, n, cx, cy, cz);
+						for (size_t j = 0; j < n; j++)
+						{
+							weighted[i + j].x = cx[j];
+							weighted[i + j].y = cy[j];
+							weighted[i + j].z = cz[j];
+						}
+					}
+				});
+		}
+	}
+
+
+	// unit face normals (counter-clockwise winding, zero for degenerate
+	// triangles) and face areas; either output may be null
+	template <typename T> void FaceNormals(const vec3<T>* positions, const uint32_t* indices, size_t triangle_count,
+		vec3<T>* normals, T* areas = nullptr)
+	{
+		ParallelFor(triangle_count, detail::mesh_grain, [positions, indices, normals, areas](size_t begin, size_t end)
+			{
+				T cx[detail::mesh_block], cy[detail::mesh_block], cz[detail::mesh_block], length[detail::mesh_block];
+				for (size_t i = begin; i < end; i += detail::mesh_block)
+				{
+					const size_t n = (end - i < detail::mesh_block) ? end - i : detail::mesh_block;
+					detail::FaceCrossBlock(positions, indices, i, n, cx, cy, cz);
+					for (size_t j = 0; j < n; j++)
+						length[j] = T(sqrt(cx[j] * cx[j] + cy[j] * cy[j] + cz[j] * cz[j]));
+
+					if (areas)
+					{
+						for (size_t j = 0; j < n; j++)
+							areas[i + j] = T(0.5) * length[j];
+					}
+					if (normals)
+					{
+						for (size_t j = 0; j < n; j++)
+						{
+							const T inv = length[j] > T(0) ? T(1) / length[j] : T(0);
+							normals[i + j].x = cx[j] * inv;
+							normals[i + j].y = cy[j] * inv;
+							normals[i + j].z = cz[j] * inv;
+						}
+					}
+				}
+			});
+	}
+	template <typename T> void FaceAreas(const vec3<T>* positions, const uint32_t* indices, size_t triangle_count, T* areas)
+	{
+		FaceNormals(positions, indices, triangle_count, (vec3<T>*)nullptr, areas);
+	}
+	// total surface area, deterministic
+	template <typename T> T SurfaceArea(const vec3<T>* positions, const uint32_t* indices, size_t triangle_count)
+	{
+		return ParallelReduce(triangle_count, detail::mesh_grain, T(0),
+			[positions, indices](size_t begin, size_t end)
+			{
+				T cx[detail::mesh_block], cy[detail::mesh_block], cz[detail::mesh_block];
+				T sum = T(0);
+				for (size_t i = begin; i < end; i += detail::mesh_block)
+				{
+					const size_t n = (end - i < detail::mesh_block) ? end - i : detail::mesh_block;
+					detail::FaceCrossBlock(positions, indices, i, n, cx, cy, cz);
+					for (size_t j = 0; j < n; j++)
+						sum += T(sqrt(cx[j] * cx[j] + cy[j] * cy[j] + cz[j] * cz[j]));
+				}
+				return T(0.5) * sum;
+			},
+			[](T a, T b) { return a + b; });
+	}
+
+	// CSR faces around each vertex, faces in ascending order per vertex.
+	// Counts and slots are claimed with relaxed atomics in parallel, the
+	// short per vertex lists are sorted afterwards to fix their order.
+	inline void BuildVertexAdjacency(const uint32_t* indices, size_t triangle_count, size_t vertex_count,
+		vertex_adjacency& adjacency)
+	{
+		std::vector<std::atomic<uint32_t>> counts(vertex_count + 1u);
+		ParallelFor(vertex_count + 1u, detail::mesh_grain, [&counts](size_t begin, size_t end)
+			{
+				for (size_t v = begin; v < end; v++)
+					counts[v].store(0u, std::memory_order_relaxed);
+			});
+		ParallelFor(triangle_count * 3u, detail::mesh_grain, [indices, &counts](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+					counts[indices[i]].fetch_add(1u, std::memory_order_relaxed);
+			});
+
+		adjacency.offsets.resize(vertex_count + 1u);
+		uint32_t sum = 0u;
+		for (size_t v = 0; v < vertex_count; v++)
+		{
+			adjacency.offsets[v] = sum;
+			sum += counts[v].load(std::memory_order_relaxed);
+			counts[v].store(adjacency.offsets[v], std::memory_order_relaxed);
+		}
+		adjacency.offsets[vertex_count] = sum;
+		adjacency.faces.resize(sum);
+
+		uint32_t* faces = adjacency.faces.data();
+		ParallelFor(triangle_count * 3u, detail::mesh_grain, [indices, &counts, faces](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+					faces[counts[indices[i]].fetch_add(1u, std::memory_order_relaxed)] = uint32_t(i / 3u);
+			});
+
+		const uint32_t* offsets = adjacency.offsets.data();
+		ParallelFor(vertex_count, detail::mesh_grain, [offsets, faces](size_t begin, size_t end)
+			{
+				for (size_t v = begin; v < end; v++)
+				{
+					for (uint32_t i = offsets[v] + 1u; i < offsets[v + 1]; i++)
+					{
+						const uint32_t face = faces[i];
+						uint32_t k = i;
+						for (; k > offsets[v] && faces[k - 1u] > face; k--)
+							faces[k] = faces[k - 1u];
+						faces[k] = face;
+					}
+				}
+			});
+	}
+
+	// unit vertex normals weighted by the areas of the adjacent faces,
+	// zero for unreferenced vertices; weighted holds triangle_count
+	// scratch entries so repeated calls don't allocate
+	template <typename T> void VertexNormals(const vec3<T>* positions, size_t vertex_count,
+		const uint32_t* indices, size_t triangle_count, const vertex_adjacency& adjacency,
+		vec3<T>* normals, std::vector<vec3<T>>& weighted)
+	{
+		weighted.resize(triangle_count);
+		detail::WeightedFaceNormals(positions, indices, triangle_count, weighted.data());
+
+		const vec3<T>* face_normals = weighted.data();
+		const uint32_t* offsets = adjacency.offsets.data();
+		const uint32_t* faces = adjacency.faces.data();
+		ParallelFor(vertex_count, detail::mesh_grain, [face_normals, offsets, faces, normals](size_t begin, size_t end)
+			{
+				for (size_t v = begin; v < end; v++)
+				{
+					T x = T(0), y = T(0), z = T(0);
+					for (uint32_t i = offsets[v]; i < offsets[v + 1]; i++)
+					{
+						const vec3<T>& n = face_normals[faces[i]];
+						x += n.x;
+						y += n.y;
+						z += n.z;
+					}
+					const T length_squared = x * x + y * y + z * z;
+					const T inv = length_squared > T(0) ? T(1) / T(sqrt(length_squared)) : T(0);
+					normals[v].x = x * inv;
+					normals[v].y = y * inv;
+					normals[v].z = z * inv;
+				}
+			});
+	}
+	template <typename T> void VertexNormals(const vec3<T>* positions, size_t vertex_count,
+		const uint32_t* indices, size_t triangle_count, vec3<T>* normals)
+	{
+		vertex_adjacency adjacency;
+		std::vector<vec3<T>> weighted;
+		BuildVertexAdjacency(indices, triangle_count, vertex_count, adjacency);
+		VertexNormals(positions, vertex_count, indices, triangle_count, adjacency, normals, weighted);
+	}
+}
+
+#endif // !MESH_H
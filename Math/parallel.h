@@ -0,0 +1,187 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Math
+{
+	class thread_pool
+	{
+	private:
+		std::vector<std::thread> workers;
+		std::deque<std::function<void()>> tasks;
+		std::mutex mutex;
+		std::condition_variable condition;
+		bool stopping = false;
+
+
+	public:
+		explicit thread_pool(unsigned int thread_count)
+		{
+			if (thread_count < 1) thread_count = 1;
+
+			workers.reserve(thread_count);
+			for (unsigned int i = 0; i < thread_count; i++)
+			{
+				workers.emplace_back([this]() { WorkerLoop(); });
+			}
+		}
+		thread_pool(const thread_pool&) = delete;
+		thread_pool& operator=(const thread_pool&) = delete;
+		~thread_pool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			condition.notify_all();
+			for (std::thread& worker : workers)
+			{
+				worker.join();
+			}
+		}
+
+
+	public:
+		void Submit(std::function<void()> task)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				tasks.push_back(std::move(task));
+			}
+			condition.notify_one();
+		}
+		unsigned int GetThreadCount() const
+		{
+			return (unsigned int)workers.size();
+		}
+
+		// process wide pool, the thread calling ParallelFor works alongside it
+		static thread_pool& Shared()
+		{
+			static thread_pool pool(std::max(1u, std::thread::hardware_concurrency()) - 1u);
+			return pool;
+		}
+
+
+	private:
+		void WorkerLoop()
+		{
+			for (;;)
+			{
+				std::function<void()> task;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+					if (stopping && tasks.empty())
+						return;
+
+					task = std::move(tasks.front());
+					tasks.pop_front();
+				}
+				task();
+			}
+		}
+	};
+
+	// Splits [0, count) into chunks of 'grain' elements and calls
+	// func(chunk_index, begin, end) for each of them on the shared pool.
+	// Chunk boundaries depend only on count and grain, never on the number
+	// of threads, so per chunk partial results combined in chunk order
+	// give the same value on every machine.
+	template <typename F>
+	void ParallelForChunks(size_t count, size_t grain, const F& func)
+	{
+		if (count == 0) return;
+		if (grain < 1) grain = 1;
+
+		const size_t chunk_count = (count + grain - 1) / grain;
+		thread_pool& pool = thread_pool::Shared();
+		if (chunk_count == 1 || pool.GetThreadCount() == 0)
+		{
+			for (size_t c = 0; c < chunk_count; c++)
+			{
+				func(c, c * grain, std::min(count, (c + 1) * grain));
+			}
+			return;
+		}
+
+		struct job_state
+		{
+			std::atomic<size_t> next{ 0 };
+			std::atomic<size_t> done{ 0 };
+			size_t chunk_count = 0;
+			std::function<void(size_t)> run;
+			std::mutex mutex;
+			std::condition_variable finished;
+
+			void Work()
+			{
+				size_t c;
+				while ((c = next.fetch_add(1)) < chunk_count)
+				{
+					run(c);
+					if (done.fetch_add(1) + 1 == chunk_count)
+					{
+						std::lock_guard<std::mutex> lock(mutex);
+						finished.notify_all();
+					}
+				}
+			}
+		};
+
+		// helpers which start late find no chunks left and never touch func
+		std::shared_ptr<job_state> job = std::make_shared<job_state>();
+		job->chunk_count = chunk_count;
+		job->run = [&func, grain, count](size_t c)
+		{
+			func(c, c * grain, std::min(count, (c + 1) * grain));
+		};
+
+		const size_t helpers = std::min<size_t>(pool.GetThreadCount(), chunk_count - 1);
+		for (size_t i = 0; i < helpers; i++)
+		{
+			pool.Submit([job]() { job->Work(); });
+		}
+		job->Work();
+
+		std::unique_lock<std::mutex> lock(job->mutex);
+		job->finished.wait(lock, [&job]() { return job->done.load() == job->chunk_count; });
+	}
+	template <typename F>
+	void ParallelFor(size_t count, size_t grain, const F& func)
+	{
+		ParallelForChunks(count, grain,
+			[&func](size_t, size_t begin, size_t end) { func(begin, end); });
+	}
+
+	// Reduces [0, count) with range(begin, end) per chunk and folds the
+	// chunk results left to right with combine, deterministic as above.
+	template <typename R, typename Range, typename Combine>
+	R ParallelReduce(size_t count, size_t grain, const R& identity, const Range& range, const Combine& combine)
+	{
+		if (count == 0) return identity;
+		if (grain < 1) grain = 1;
+
+		std::vector<R> partials((count + grain - 1) / grain, identity);
+		ParallelForChunks(count, grain,
+			[&partials, &range](size_t chunk, size_t begin, size_t end) { partials[chunk] = range(begin, end); });
+
+		R result = partials[0];
+		for (size_t c = 1; c < partials.size(); c++)
+		{
+			result = combine(result, partials[c]);
+		}
+		return result;
+	}
+}
+
+#endif // !PARALLEL_H
\ No newline at end of file
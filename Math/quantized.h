@@ -0,0 +1,386 @@
+#ifndef QUANTIZED_H
+#define QUANTIZED_H
+
+#include "Matrix.h"
+#include "parallel.h"
+
+#include <math.h>	// nearbyintf()
+#include <stdint.h>
+#include <string.h>	// memcpy()
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace Math
+{
+	// 8 bit affine quantized matrix, real = scale * (q - zero_point)
+	template <typename Q> class qmatrix
+	{
+	private:
+		size_t rows, columns;
+		Q *storage = nullptr;
+		float scale;
+		int32_t zero_point;
+
+
+	public:
+		qmatrix(const qmatrix<Q>& M)
+			: rows(M.rows), columns(M.columns), scale(M.scale), zero_point(M.zero_point)
+		{
+			storage = new Q[rows * columns];
+			memcpy(storage, M.storage, rows * columns * sizeof(Q));
+		}
+		qmatrix(qmatrix<Q>&& M)
+			: rows(M.rows), columns(M.columns), scale(M.scale), zero_point(M.zero_point)
+		{
+			storage = M.storage;
+			M.storage = nullptr;
+
+			M.rows = 0;
+			M.columns = 0;
+		}
+		qmatrix(unsigned int rows, unsigned int columns, float scale = 1.0f, int32_t zero_point = 0)
+		{
+			if (rows < 1) rows = 1;
+			if (columns < 1) columns = 1;
+
+			this->rows = rows;
+			this->columns = columns;
+			this->scale = scale;
+			this->zero_point = zero_point;
+
+			storage = new Q[this->rows * this->columns];
+			for (size_t i = 0; i < this->rows * this->columns; i++)
+			{
+				storage[i] = Q(zero_point);
+			}
+		}
+		~qmatrix()
+		{
+			delete[] storage;
+		}
+
+
+	public:
+		qmatrix<Q>& operator=(const qmatrix<Q>& M)
+		{
+			if (&M == this)
+				return *this;
+
+			if (rows * columns != M.rows * M.columns)
+			{
+				delete[] storage;
+				storage = new Q[M.rows * M.columns];
+			}
+
+			rows = M.rows;
+			columns = M.columns;
+			scale = M.scale;
+			zero_point = M.zero_point;
+			memcpy(storage, M.storage, rows * columns * sizeof(Q));
+
+			return *this;
+		}
+		qmatrix<Q>& operator=(qmatrix<Q>&& M)
+		{
+			if (&M == this)
+				return *this;
+
+			delete[] storage;
+			storage = M.storage;
+			M.storage = nullptr;
+
+			rows = M.rows;
+			columns = M.columns;
+			scale = M.scale;
+			zero_point = M.zero_point;
+
+			return *this;
+		}
+
+
+	public:
+		Q& Value(unsigned int row, unsigned int column)
+		{
+			return storage[row * columns + column];
+		}
+		const Q& Value(unsigned int row, unsigned int column) const
+		{
+			return storage[row * columns + column];
+		}
+		void Value(unsigned int row, unsigned int column, const Q& value)
+		{
+			Value(row, column) = value;
+		}
+		Q* Data()
+		{
+			return storage;
+		}
+		const Q* Data() const
+		{
+			return storage;
+		}
+
+		unsigned int GetRows() const
+		{
+			return (unsigned int)rows;
+		}
+		unsigned int GetColumns() const
+		{
+			return (unsigned int)columns;
+		}
+		float Scale() const
+		{
+			return scale;
+		}
+		int32_t ZeroPoint() const
+		{
+			return zero_point;
+		}
+	};
+
+	typedef qmatrix<int8_t> qmatrix_i8;
+	typedef qmatrix<uint8_t> qmatrix_u8;
+
+
+	namespace detail
+	{
+		template <typename Q> struct quantized_range;
+		template <> struct quantized_range<int8_t>
+		{
+			static constexpr int32_t min = -128;
+			static constexpr int32_t max = 127;
+		};
+		template <> struct quantized_range<uint8_t>
+		{
+			static constexpr int32_t min = 0;
+			static constexpr int32_t max = 255;
+		};
+
+		constexpr size_t quantize_grain = 1u << 16;
+
+		// round(x) + zero_point saturated to Q, NaN to the zero point;
+		// clamped in float, the int conversion of an out of range value
+		// is undefined
+		template <typename Q> Q Saturate(float x, int32_t zero_point)
+		{
+			const float q_min = float(quantized_range<Q>::min);
+			const float q_max = float(quantized_range<Q>::max);
+			float v = nearbyintf(x) + float(zero_point);
+			if (v != v) v = float(zero_point);
+			v = v < q_min ? q_min : (v > q_max ? q_max : v);
+			return Q(int32_t(v));
+		}
+
+#if defined(__AVX2__)
+		inline __m256i Widen(__m128i v, int8_t)
+		{
+			return _mm256_cvtepi8_epi16(v);
+		}
+		inline __m256i Widen(__m128i v, uint8_t)
+		{
+			return _mm256_cvtepu8_epi16(v);
+		}
+#endif
+
+		// raw 8 bit dot product, both operands widened to 16 bit and
+		// multiplied pairwise into int32 lanes (pmaddwd), which is exact
+		// for every 8 bit combination
+		template <typename QA, typename QB>
+		int32_t Dot(const QA* a, const QB* b, size_t n)
+		{
+			int32_t sum = 0;
+			size_t k = 0;
+#if defined(__AVX2__)
+			__m256i acc = _mm256_setzero_si256();
+			for (; k + 16 <= n; k += 16)
+			{
+				const __m256i va = Widen(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + k)), QA());
+				const __m256i vb = Widen(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + k)), QB());
+				acc = _mm256_add_epi32(acc, _mm256_madd_epi16(va, vb));
+			}
+			__m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+			s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+			s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+			sum = _mm_cvtsi128_si32(s);
+#endif
+			for (; k < n; k++)
+			{
+				sum += int32_t(a[k]) * int32_t(b[k]);
+			}
+			return sum;
+		}
+	}
+
+
+	// quantization with given parameters
+	template <typename Q> qmatrix<Q> Quantize(const matrix<float>& M, float scale, int32_t zero_point)
+	{
+		qmatrix<Q> Result(M.GetRows(), M.GetColumns(), scale, zero_point);
+		const size_t count = size_t(M.GetRows()) * M.GetColumns();
+		std::vector<float> packed;
+		const float* source = PackedData(M, packed);
+		Q* destination = Result.Data();
+		const float r_scale = 1.0f / scale;
+
+		ParallelFor(count, detail::quantize_grain,
+			[=](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					destination[i] = detail::Saturate<Q>(source[i] * r_scale, zero_point);
+				}
+			});
+		return Result;
+	}
+	// quantization over the value range of M (always including zero)
+	template <typename Q> qmatrix<Q> Quantize(const matrix<float>& M)
+	{
+		std::vector<float> packed;
+		const float* data = PackedData(M, packed);
+		float lo = 0.0f, hi = 0.0f;
+		for (size_t i = 0; i < size_t(M.GetRows()) * M.GetColumns(); i++)
+		{
+			lo = data[i] < lo ? data[i] : lo;
+			hi = data[i] > hi ? data[i] : hi;
+		}
+
+		const int32_t q_min = detail::quantized_range<Q>::min;
+		const int32_t q_max = detail::quantized_range<Q>::max;
+		float scale = (hi - lo) / float(q_max - q_min);
+		if (scale == 0.0f) scale = 1.0f;
+
+		int32_t zero_point = q_min - int32_t(nearbyintf(lo / scale));
+		zero_point = zero_point < q_min ? q_min : (zero_point > q_max ? q_max : zero_point);
+		return Quantize<Q>(M, scale, zero_point);
+	}
+	template <typename Q> matrix<float> Dequantize(const qmatrix<Q>& M)
+	{
+		matrix<float> Result(M.GetRows(), M.GetColumns());
+		const size_t count = size_t(M.GetRows()) * M.GetColumns();
+		const Q* source = M.Data();
+		float* destination = Result.Data();
+		const float scale = M.Scale();
+		const int32_t zero_point = M.ZeroPoint();
+
+		ParallelFor(count, detail::quantize_grain,
+			[=](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					destination[i] = scale * float(int32_t(source[i]) - zero_point);
+				}
+			});
+		return Result;
+	}
+
+
+	// Sum over k of (A[i][k] - za) * (B[k][j] - zb), accumulated in int32.
+	// The zero points are folded in afterwards through row sums of A and
+	// column sums of B, so the inner loop is a plain 8 bit dot product.
+	// Accumulation can overflow for inner dimensions above ~33000 (uint8).
+	// Result is resized to A.rows x B.columns; returns false (Result
+	// untouched) when the inner dimensions don't match.
+	template <typename QA, typename QB>
+	bool QuantizedProduct(const qmatrix<QA>& A, const qmatrix<QB>& B, matrix<int32_t>& Result)
+	{
+		if (A.GetColumns() != B.GetRows())
+			return false;
+
+		const unsigned int rows = A.GetRows();
+		const unsigned int columns = B.GetColumns();
+		const unsigned int depth = A.GetColumns();
+		const int32_t za = A.ZeroPoint();
+		const int32_t zb = B.ZeroPoint();
+
+		// B transposed so each output element reads two contiguous rows
+		std::vector<QB> bt(size_t(depth) * columns);
+		std::vector<int32_t> b_sums(columns, 0);
+		const QB* b = B.Data();
+		for (unsigned int k = 0; k < depth; k++)
+		{
+			for (unsigned int j = 0; j < columns; j++)
+			{
+				bt[size_t(j) * depth + k] = b[size_t(k) * columns + j];
+				b_sums[j] += int32_t(b[size_t(k) * columns + j]);
+			}
+		}
+
+		if (Result.GetRows() != rows || Result.GetColumns() != columns)
+			Result = matrix<int32_t>(rows, columns);
+		const QA* a = A.Data();
+		const QB* b_packed = bt.data();
+		const int32_t* column_sums = b_sums.data();
+		int32_t* c = Result.Data();
+		const size_t ldc = Result.LeadingDimension();
+
+		ParallelFor(rows, 16,
+			[=](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					const QA* a_row = a + i * depth;
+					int32_t row_sum = 0;
+					for (unsigned int k = 0; k < depth; k++)
+						row_sum += int32_t(a_row[k]);
+
+					const int32_t offset = int32_t(depth) * za * zb - zb * row_sum;
+					for (unsigned int j = 0; j < columns; j++)
+					{
+						c[i * ldc + j] = detail::Dot(a_row, b_packed + size_t(j) * depth, depth)
+							- za * column_sums[j] + offset;
+					}
+				}
+			});
+		return true;
+	}
+	// product scaled back to real values, same rules as above
+	template <typename QA, typename QB>
+	bool DequantizedProduct(const qmatrix<QA>& A, const qmatrix<QB>& B, matrix<float>& Result)
+	{
+		matrix<int32_t> Accumulator(1, 1);
+		if (!QuantizedProduct(A, B, Accumulator))
+			return false;
+
+		if (Result.GetRows() != Accumulator.GetRows() || Result.GetColumns() != Accumulator.GetColumns())
+			Result = matrix<float>(Accumulator.GetRows(), Accumulator.GetColumns());
+		const float scale = A.Scale() * B.Scale();
+		const int32_t* source = Accumulator.Data();
+		float* destination = Result.Data();
+		const size_t ld = Result.LeadingDimension();
+		for (size_t i = 0; i < Result.GetRows(); i++)
+		{
+			for (size_t j = 0; j < Result.GetColumns(); j++)
+			{
+				destination[i * ld + j] = scale * float(source[i * Result.GetColumns() + j]);
+			}
+		}
+		return true;
+	}
+	// product requantized to Result's scale and zero point, same rules
+	// as above
+	template <typename Q, typename QA, typename QB>
+	bool QuantizedProduct(const qmatrix<QA>& A, const qmatrix<QB>& B, qmatrix<Q>& Result)
+	{
+		matrix<int32_t> Accumulator(1, 1);
+		if (!QuantizedProduct(A, B, Accumulator))
+			return false;
+
+		const float scale = Result.Scale();
+		const int32_t zero_point = Result.ZeroPoint();
+		if (Result.GetRows() != Accumulator.GetRows() || Result.GetColumns() != Accumulator.GetColumns())
+			Result = qmatrix<Q>(Accumulator.GetRows(), Accumulator.GetColumns(), scale, zero_point);
+		const float multiplier = A.Scale() * B.Scale() / scale;
+		const int32_t* source = Accumulator.Data();
+		Q* destination = Result.Data();
+		for (size_t i = 0; i < size_t(Result.GetRows()) * Result.GetColumns(); i++)
+		{
+			destination[i] = detail::Saturate<Q>(multiplier * float(source[i]), zero_point);
+		}
+		return true;
+	}
+}
+
+#endif // !QUANTIZED_H
\ No newline at end of file
@@ -0,0 +1,316 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include "parallel.h"
+#include "vec2.h"
+#include "vec3.h"
+
+#include <math.h>	// sqrt(), sin(), cos()
+#include <stddef.h>
+#include <stdint.h>
+
+namespace Math
+{
+	// Philox4x32-10 counter-based generator (Salmon et al., "Parallel
+	// random numbers: as easy as 1, 2, 3"). Block n of a stream is a pure
+	// function of (seed, stream, n), so any range of samples can be
+	// produced by any thread in any order with identical results. Give
+	// each thread, tile or pass its own stream number instead of sharing
+	// a generator.
+	//
+	// The bulk samplers use one block per sample, starting at the
+	// generator's position and advancing it by the sample count. Samples
+	// are produced in batches: counters are hashed into a lane-wise buffer
+	// first (32x32->64 bit multiplies the compiler vectorizes), then
+	// mapped to points with branch-free polynomial sine and cosine.
+	class philox4x32
+	{
+	private:
+		uint64_t seed, stream, position;
+
+		static constexpr uint32_t multiplier0 = 0xD2511F53u;
+		static constexpr uint32_t multiplier1 = 0xCD9E8D57u;
+		static constexpr uint32_t weyl0 = 0x9E3779B9u;
+		static constexpr uint32_t weyl1 = 0xBB67AE85u;
+
+
+	public:
+		explicit philox4x32(uint64_t seed = 0u, uint64_t stream = 0u, uint64_t position = 0u)
+			: seed(seed)
+			, stream(stream)
+			, position(position)
+		{}
+
+
+	public:
+		// the four 32-bit words of block index in (seed, stream)
+		static void Block(uint64_t seed, uint64_t stream, uint64_t index, uint32_t out[4])
+		{
+			uint32_t c0 = uint32_t(index), c1 = uint32_t(index >> 32);
+			uint32_t c2 = uint32_t(stream), c3 = uint32_t(stream >> 32);
+			uint32_t k0 = uint32_t(seed), k1 = uint32_t(seed >> 32);
+
+			for (unsigned int round = 0; round < 10u; round++)
+			{
+				const uint64_t p0 = uint64_t(multiplier0) * c0;
+				const uint64_t p1 = uint64_t(multiplier1) * c2;
+				const uint32_t n0 = uint32_t(p1 >> 32) ^ c1 ^ k0;
+				const uint32_t n2 = uint32_t(p0 >> 32) ^ c3 ^ k1;
+				c0 = n0;
+				c1 = uint32_t(p1);
+				c2 = n2;
+				c3 = uint32_t(p0);
+				k0 += weyl0;
+				k1 += weyl1;
+			}
+			out[0] = c0;
+			out[1] = c1;
+			out[2] = c2;
+			out[3] = c3;
+		}
+
+		// next block of this stream
+		void Next(uint32_t out[4])
+		{
+			Block(seed, stream, position++, out);
+		}
+		uint32_t NextUint32()
+		{
+			uint32_t block[4];
+			Next(block);
+			return block[0];
+		}
+		// uniform in [0, 1)
+		float NextFloat()
+		{
+			return float(NextUint32() >> 8) * (1.0f / 16777216.0f);
+		}
+		double NextDouble()
+		{
+			uint32_t block[4];
+			Next(block);
+			return double(((uint64_t(block[0]) << 32) | block[1]) >> 11) * (1.0 / 9007199254740992.0);
+		}
+
+		// skips or rewinds the stream in O(1)
+		void Seek(uint64_t new_position)
+		{
+			position = new_position;
+		}
+		void Skip(uint64_t count)
+		{
+			position += count;
+		}
+		uint64_t Position() const
+		{
+			return position;
+		}
+		uint64_t Stream() const
+		{
+			return stream;
+		}
+		uint64_t Seed() const
+		{
+			return seed;
+		}
+	};
+
+
+	namespace detail
+	{
+		constexpr size_t random_batch = 64u;
+		constexpr size_t random_grain = 8192u;
+		constexpr double two_pi = 6.283185307179586;
+
+		// two uniforms in [0, 1) per block, full precision for either type
+		inline void Uniforms(const uint32_t* w0, const uint32_t* w1, const uint32_t*, const uint32_t*,
+			float* u0, float* u1, size_t n)
+		{
+			for (size_t j = 0; j < n; j++)
+			{
+				u0[j] = float(w0[j] >> 8) * (1.0f / 16777216.0f);
+				u1[j] = float(w1[j] >> 8) * (1.0f / 16777216.0f);
+			}
+		}
+		inline void Uniforms(const uint32_t* w0, const uint32_t* w1, const uint32_t* w2, const uint32_t* w3,
+			double* u0, double* u1, size_t n)
+		{
+			for (size_t j = 0; j < n; j++)
+			{
+				u0[j] = double(((uint64_t(w0[j]) << 32) | w1[j]) >> 11) * (1.0 / 9007199254740992.0);
+				u1[j] = double(((uint64_t(w2[j]) << 32) | w3[j]) >> 11) * (1.0 / 9007199254740992.0);
+			}
+		}
+
+		// Philox over n consecutive counters into four word lanes
+		inline void Blocks(uint64_t seed, uint64_t stream, uint64_t first, size_t n,
+			uint32_t* w0, uint32_t* w1, uint32_t* w2, uint32_t* w3)
+		{
+			for (size_t j = 0; j < n; j++)
+			{
+				uint32_t block[4];
+				philox4x32::Block(seed, stream, first + j, block);
+				w0[j] = block[0];
+				w1[j] = block[1];
+				w2[j] = block[2];
+				w3[j] = block[3];
+			}
+		}
+
+		// sin and cos of 2 pi u for u in [0, 1): quarter turn reduction and
+		// Taylor polynomials on [-pi/4, pi/4], ~1e-7 absolute error in float
+		template <typename T> void SinCosTwoPi(T u, T& s, T& c)
+		{
+			const T t = u * T(4);
+			const int k = int(t + T(0.5));
+			const T a = (t - T(k)) * T(1.5707963267948966);
+			const T a2 = a * a;
+			const T sa = a * (T(1) + a2 * (T(-1.0 / 6.0) + a2 * (T(1.0 / 120.0) + a2 * (T(-1.0 / 5040.0) + a2 * T(1.0 / 362880.0)))));
+			const T ca = T(1) + a2 * (T(-0.5) + a2 * (T(1.0 / 24.0) + a2 * (T(-1.0 / 720.0) + a2 * (T(1.0 / 40320.0) + a2 * T(-1.0 / 3628800.0)))));
+
+			// rotate by k quarter turns
+			const bool odd = (k & 1) != 0;
+			const T sr = odd ? ca : sa;
+			const T cr = odd ? sa : ca;
+			s = (k & 2) ? -sr : sr;
+			c = ((k + 1) & 2) ? -cr : cr;
+		}
+		// double precision callers get the library functions
+		inline void SinCosTwoPi(double u, double& s, double& c)
+		{
+			s = sin(two_pi * u);
+			c = cos(two_pi * u);
+		}
+
+		// runs map(u0, u1, n, offset) over batches of uniforms for count
+		// samples starting at the generator position, in parallel
+		template <typename T, typename Map>
+		void SampleBatches(size_t count, philox4x32& generator, const Map& map)
+		{
+			const uint64_t seed = generator.Seed(), stream = generator.Stream(), first = generator.Position();
+			generator.Skip(count);
+
+			ParallelFor(count, random_grain, [seed, stream, first, &map](size_t begin, size_t end)
+				{
+					uint32_t w0[random_batch], w1[random_batch], w2[random_batch], w3[random_batch];
+					T u0[random_batch], u1[random_batch];
+					for (size_t i = begin; i < end; i += random_batch)
+					{
+						const size_t n = (end - i < random_batch) ? end - i : random_batch;
+						Blocks(seed, stream, first + i, n, w0, w1, w2, w3);
+						Uniforms(w0, w1, w2, w3, u0, u1, n);
+						map(u0, u1, n, i);
+					}
+				});
+		}
+
+		// orthonormal tangents of a unit normal without branches on the
+		// normal's orientation (Duff et al. 2017)
+		template <typename T> void TangentFrame(const vec3<T>& n, vec3<T>& t, vec3<T>& b)
+		{
+			const T sign = n.z < T(0) ? T(-1) : T(1);
+			const T a = T(-1) / (sign + n.z);
+			const T d = n.x * n.y * a;
+			t = vec3<T>(T(1) + sign * n.x * n.x * a, sign * d, -sign * n.x);
+			b = vec3<T>(d, sign + n.y * n.y * a, -n.y);
+		}
+	}
+
+
+	// uniform on the unit sphere
+	template <typename T> void SampleSphere(vec3<T>* out, size_t count, philox4x32& generator)
+	{
+		detail::SampleBatches<T>(count, generator, [out](const T* u0, const T* u1, size_t n, size_t offset)
+			{
+				vec3<T>* o = out + offset;
+				for (size_t j = 0; j < n; j++)
+				{
+					const T z = T(1) - T(2) * u0[j];
+					const T r = T(sqrt(T(1) - z * z > T(0) ? T(1) - z * z : T(0)));
+					T s, c;
+					detail::SinCosTwoPi(u1[j], s, c);
+					o[j].x = r * c;
+					o[j].y = r * s;
+					o[j].z = z;
+				}
+			});
+	}
+
+	// cosine weighted on the hemisphere around a unit normal, pdf cos / pi
+	template <typename T> void SampleHemisphereCosine(vec3<T>* out, size_t count, const vec3<T>& normal, philox4x32& generator)
+	{
+		vec3<T> t, b;
+		detail::TangentFrame(normal, t, b);
+		detail::SampleBatches<T>(count, generator, [out, normal, t, b](const T* u0, const T* u1, size_t n, size_t offset)
+			{
+				vec3<T>* o = out + offset;
+				for (size_t j = 0; j < n; j++)
+				{
+					const T r = T(sqrt(u0[j]));
+					const T z = T(sqrt(T(1) - u0[j]));
+					T s, c;
+					detail::SinCosTwoPi(u1[j], s, c);
+					const T x = r * c, y = r * s;
+					o[j].x = x * t.x + y * b.x + z * normal.x;
+					o[j].y = x * t.y + y * b.y + z * normal.y;
+					o[j].z = x * t.z + y * b.z + z * normal.z;
+				}
+			});
+	}
+	// one unit normal per sample
+	template <typename T> void SampleHemisphereCosine(vec3<T>* out, const vec3<T>* normals, size_t count, philox4x32& generator)
+	{
+		detail::SampleBatches<T>(count, generator, [out, normals](const T* u0, const T* u1, size_t n, size_t offset)
+			{
+				for (size_t j = 0; j < n; j++)
+				{
+					const vec3<T>& normal = normals[offset + j];
+					vec3<T> t, b;
+					detail::TangentFrame(normal, t, b);
+
+					const T r = T(sqrt(u0[j]));
+					const T z = T(sqrt(T(1) - u0[j]));
+					T s, c;
+					detail::SinCosTwoPi(u1[j], s, c);
+					const T x = r * c, y = r * s;
+					vec3<T>& o = out[offset + j];
+					o.x = x * t.x + y * b.x + z * normal.x;
+					o.y = x * t.y + y * b.y + z * normal.y;
+					o.z = x * t.z + y * b.z + z * normal.z;
+				}
+			});
+	}
+
+	// uniform on the unit disk
+	template <typename T> void SampleDisk(vec2<T>* out, size_t count, philox4x32& generator)
+	{
+		detail::SampleBatches<T>(count, generator, [out](const T* u0, const T* u1, size_t n, size_t offset)
+			{
+				vec2<T>* o = out + offset;
+				for (size_t j = 0; j < n; j++)
+				{
+					const T r = T(sqrt(u0[j]));
+					T s, c;
+					detail::SinCosTwoPi(u1[j], s, c);
+					o[j].x = r * c;
+					o[j].y = r * s;
+				}
+			});
+	}
+
+	// uniform on [0, 1)^2
+	template <typename T> void SampleSquare(vec2<T>* out, size_t count, philox4x32& generator)
+	{
+		detail::SampleBatches<T>(count, generator, [out](const T* u0, const T* u1, size_t n, size_t offset)
+			{
+				vec2<T>* o = out + offset;
+				for (size_t j = 0; j < n; j++)
+				{
+					o[j].x = u0[j];
+					o[j].y = u1[j];
+				}
+			});
+	}
+}
+
+#endif // !RANDOM_H
@@ -0,0 +1,209 @@
+#ifndef REDUCTION_H
+#define REDUCTION_H
+
+#include "parallel.h"
+#include "vec2.h"
+#include "vec3.h"
+
+#include <stddef.h>
+
+namespace Math
+{
+	// axis aligned box spanned by component-wise min and max
+	template <typename V> struct bounds
+	{
+	public:
+		V min, max;
+
+	public:
+		bounds()
+			: min()
+			, max()
+		{}
+		bounds(const V& min, const V& max)
+			: min(min)
+			, max(max)
+		{}
+	};
+
+	// elements handled by one task, fixed so results don't depend on thread count
+	constexpr size_t reduction_grain = 16384u;
+
+	namespace detail
+	{
+		template <typename T> vec2<T> ComponentMin(const vec2<T>& a, const vec2<T>& b)
+		{
+			return vec2<T>(b.x < a.x ? b.x : a.x, b.y < a.y ? b.y : a.y);
+		}
+		template <typename T> vec3<T> ComponentMin(const vec3<T>& a, const vec3<T>& b)
+		{
+			return vec3<T>(b.x < a.x ? b.x : a.x, b.y < a.y ? b.y : a.y, b.z < a.z ? b.z : a.z);
+		}
+		template <typename T> vec2<T> ComponentMax(const vec2<T>& a, const vec2<T>& b)
+		{
+			return vec2<T>(b.x > a.x ? b.x : a.x, b.y > a.y ? b.y : a.y);
+		}
+		template <typename T> vec3<T> ComponentMax(const vec3<T>& a, const vec3<T>& b)
+		{
+			return vec3<T>(b.x > a.x ? b.x : a.x, b.y > a.y ? b.y : a.y, b.z > a.z ? b.z : a.z);
+		}
+
+		template <typename K> struct arg_key
+		{
+			size_t index;
+			K key;
+		};
+
+		// four independent accumulators keep the loop free of a serial
+		// dependency chain so it vectorizes without reassociation
+		template <typename V> V SumRange(const V* points, size_t begin, size_t end)
+		{
+			V acc[4];
+			size_t i = begin;
+			for (; i + 4 <= end; i += 4)
+			{
+				acc[0] += points[i];
+				acc[1] += points[i + 1];
+				acc[2] += points[i + 2];
+				acc[3] += points[i + 3];
+			}
+			for (; i < end; i++)
+			{
+				acc[0] += points[i];
+			}
+			return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+		}
+		template <typename V> bounds<V> BoundsRange(const V* points, size_t begin, size_t end)
+		{
+			V lo[4] = { points[begin], points[begin], points[begin], points[begin] };
+			V hi[4] = { points[begin], points[begin], points[begin], points[begin] };
+			size_t i = begin + 1;
+			for (; i + 4 <= end; i += 4)
+			{
+				for (unsigned int k = 0; k < 4; k++)
+				{
+					lo[k] = ComponentMin(lo[k], points[i + k]);
+					hi[k] = ComponentMax(hi[k], points[i + k]);
+				}
+			}
+			for (; i < end; i++)
+			{
+				lo[0] = ComponentMin(lo[0], points[i]);
+				hi[0] = ComponentMax(hi[0], points[i]);
+			}
+			return bounds<V>(
+				ComponentMin(ComponentMin(lo[0], lo[1]), ComponentMin(lo[2], lo[3])),
+				ComponentMax(ComponentMax(hi[0], hi[1]), ComponentMax(hi[2], hi[3])));
+		}
+
+		// Key(v) is compared, ties keep the lowest index
+		template <bool Greater, typename V, typename Key>
+		size_t ArgExtreme(const V* points, size_t count, const Key& key)
+		{
+			typedef decltype(key(points[0])) K;
+			if (count == 0) return count;
+
+			const arg_key<K> identity = { 0u, key(points[0]) };
+			arg_key<K> result = ParallelReduce(count, reduction_grain, identity,
+				[points, &key](size_t begin, size_t end)
+				{
+					arg_key<K> best = { begin, key(points[begin]) };
+					for (size_t i = begin + 1; i < end; i++)
+					{
+						const K k = key(points[i]);
+						if (Greater ? (k > best.key) : (k < best.key))
+						{
+							best.index = i;
+							best.key = k;
+						}
+					}
+					return best;
+				},
+				[](const arg_key<K>& a, const arg_key<K>& b)
+				{
+					return (Greater ? (b.key > a.key) : (b.key < a.key)) ? b : a;
+				});
+			return result.index;
+		}
+	}
+
+
+	// sum and mean
+	template <typename V> V Sum(const V* points, size_t count)
+	{
+		return ParallelReduce(count, reduction_grain, V(),
+			[points](size_t begin, size_t end) { return detail::SumRange(points, begin, end); },
+			[](const V& a, const V& b) { return a + b; });
+	}
+	template <typename V> V Mean(const V* points, size_t count)
+	{
+		if (count == 0) return V();
+		return Sum(points, count) / static_cast<decltype(V().x)>(count);
+	}
+	template <typename V> decltype(V().x) SumMagnitude(const V* points, size_t count)
+	{
+		typedef decltype(V().x) T;
+		return ParallelReduce(count, reduction_grain, T(0),
+			[points](size_t begin, size_t end)
+			{
+				T acc[4] = { T(0), T(0), T(0), T(0) };
+				size_t i = begin;
+				for (; i + 4 <= end; i += 4)
+				{
+					for (unsigned int k = 0; k < 4; k++)
+						acc[k] += points[i + k].Magnitude();
+				}
+				for (; i < end; i++)
+				{
+					acc[0] += points[i].Magnitude();
+				}
+				return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+			},
+			[](const T& a, const T& b) { return a + b; });
+	}
+
+	// component-wise extremes, empty input gives zero vectors
+	template <typename V> bounds<V> Bounds(const V* points, size_t count)
+	{
+		if (count == 0) return bounds<V>();
+		return ParallelReduce(count, reduction_grain, bounds<V>(points[0], points[0]),
+			[points](size_t begin, size_t end) { return detail::BoundsRange(points, begin, end); },
+			[](const bounds<V>& a, const bounds<V>& b)
+			{
+				return bounds<V>(detail::ComponentMin(a.min, b.min), detail::ComponentMax(a.max, b.max));
+			});
+	}
+	template <typename V> V Min(const V* points, size_t count)
+	{
+		return Bounds(points, count).min;
+	}
+	template <typename V> V Max(const V* points, size_t count)
+	{
+		return Bounds(points, count).max;
+	}
+
+	// index of the shortest/longest vector or nearest/farthest point,
+	// count when the input is empty
+	template <typename V> size_t ArgMinMagnitude(const V* points, size_t count)
+	{
+		return detail::ArgExtreme<false>(points, count,
+			[](const V& v) { return V::DotProduct(v, v); });
+	}
+	template <typename V> size_t ArgMaxMagnitude(const V* points, size_t count)
+	{
+		return detail::ArgExtreme<true>(points, count,
+			[](const V& v) { return V::DotProduct(v, v); });
+	}
+	template <typename V> size_t ArgMinDistance(const V* points, size_t count, const V& point)
+	{
+		return detail::ArgExtreme<false>(points, count,
+			[&point](const V& v) { const V d = v - point; return V::DotProduct(d, d); });
+	}
+	template <typename V> size_t ArgMaxDistance(const V* points, size_t count, const V& point)
+	{
+		return detail::ArgExtreme<true>(points, count,
+			[&point](const V& v) { const V d = v - point; return V::DotProduct(d, d); });
+	}
+}
+
+#endif // !REDUCTION_H
\ No newline at end of file
@@ -0,0 +1,404 @@
+#ifndef SHARED_MATRIX_H
+#define SHARED_MATRIX_H
+
+#include "gemm.h"
+#include "Matrix.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <errno.h>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace Math
+{
+	// Matrices in POSIX shared memory and a product sharded over forked
+	// worker processes (Linux; link with -lrt on glibc before 2.34).
+	//
+	// CreateSharedMatrix maps a MAP_SHARED segment, anonymous or under a
+	// shm_open name other local processes can attach to with
+	// OpenSharedMatrix, and adopts it as an external_buffer: writes from
+	// any process are visible to all without copying. The creator
+	// unlinks a named segment when its matrix lets go of it.
+	//
+	// ShardedGemm splits Result into row or column shards and forks
+	// worker processes that pull shards from a counter in a shared
+	// control page and compute them single threaded into Result, which
+	// must be shared; the operands are inherited by the workers either
+	// way. Workers that stop making progress (a lock inherited held, a
+	// stopped process) are killed after shard_options::stall_timeout_ms.
+	// Shards a worker didn't finish (crash, kill, failed fork) are
+	// computed by the caller on its thread pool, as is the whole product
+	// when Result is private memory or the platform has no fork, so the
+	// result is always complete.
+
+	enum class shard_axis
+	{
+		rows,		// workers own row ranges of A and Result, read all of B
+		columns		// column ranges of B and Result, read all of A
+	};
+	struct shard_options
+	{
+		unsigned int processes = 0u;	// 0: one per hardware thread
+		unsigned int shards = 0u;		// 0: 4 per process
+		shard_axis axis = shard_axis::rows;
+		// workers are killed when no shard finishes for this long, 0: a
+		// second plus 10 ms per million multiply-adds of a shard
+		unsigned int stall_timeout_ms = 0u;
+	};
+
+	namespace detail
+	{
+		constexpr uint64_t shared_matrix_magic = 0x78697274614d6853u;	// "ShMatrix"
+		constexpr size_t shared_header_bytes = 4096u;	// keeps the elements page aligned
+		constexpr size_t shard_column_alignment = 64u;	// bytes, no cache line split between workers
+		constexpr unsigned int shard_poll_ms = 1u;
+
+		struct shared_matrix_header
+		{
+			uint64_t magic;
+			uint64_t element_size;
+			uint64_t rows, columns;
+		};
+
+		// mapped shared segments of this process, for IsShared
+		struct shared_regions
+		{
+			std::mutex mutex;
+			std::vector<std::pair<const char*, size_t>> regions;
+
+			static shared_regions& Instance()
+			{
+				static shared_regions instance;
+				return instance;
+			}
+			void Add(const void* begin, size_t bytes)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				regions.emplace_back(static_cast<const char*>(begin), bytes);
+			}
+			void Remove(const void* begin)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				for (size_t i = 0; i < regions.size(); i++)
+				{
+					if (regions[i].first == begin)
+					{
+						regions[i] = regions.back();
+						regions.pop_back();
+						return;
+					}
+				}
+			}
+			bool Contains(const void* address)
+			{
+				const char* p = static_cast<const char*>(address);
+				std::lock_guard<std::mutex> lock(mutex);
+				for (const std::pair<const char*, size_t>& region : regions)
+				{
+					if (p >= region.first && p < region.first + region.second)
+						return true;
+				}
+				return false;
+			}
+		};
+
+#if defined(__linux__)
+		// header and elements of a mapped segment as a matrix, unmapped
+		// (and unlinked when name isn't empty) by the matrix
+		template <typename T> std::unique_ptr<matrix<T>> AdoptSegment(void* memory, size_t bytes, std::string unlink_name)
+		{
+			shared_regions::Instance().Add(memory, bytes);
+			const shared_matrix_header* header = static_cast<const shared_matrix_header*>(memory);
+			T* data = reinterpret_cast<T*>(static_cast<char*>(memory) + shared_header_bytes);
+			external_buffer<T> buffer(data, size_t(header->columns), [memory, bytes, unlink_name](T*)
+				{
+					shared_regions::Instance().Remove(memory);
+					munmap(memory, bytes);
+					if (!unlink_name.empty()) shm_unlink(unlink_name.c_str());
+				});
+			return std::unique_ptr<matrix<T>>(new matrix<T>(unsigned(header->rows), unsigned(header->columns), std::move(buffer)));
+		}
+#endif
+
+		inline size_t ShardBoundary(size_t extent, size_t shard, size_t shards, size_t alignment)
+		{
+			if (shard >= shards) return extent;
+			const size_t boundary = extent * shard / shards / alignment * alignment;
+			return boundary < extent ? boundary : extent;
+		}
+
+		// one shard; serial runs it on the calling thread through GemmRows
+		// alone, which is all a forked worker may do: the child has only the
+		// forking thread, and a lock (malloc, the pool's static guard) held
+		// by another parent thread at fork time stays held forever
+		template <typename T> void GemmShard(const matrix<T>& A, const matrix<T>& B, matrix<T>& C,
+			shard_axis axis, size_t begin, size_t end, bool serial)
+		{
+			const size_t lda = A.LeadingDimension(), ldb = B.LeadingDimension(), ldc = C.LeadingDimension();
+			size_t m = C.GetRows(), n = C.GetColumns();
+			const size_t k = A.GetColumns();
+			const T* a = A.Data();
+			const T* b = B.Data();
+			T* c = C.Data();
+			if (axis == shard_axis::rows)
+			{
+				a += begin * lda;
+				c += begin * ldc;
+				m = end - begin;
+			}
+			else
+			{
+				b += begin;
+				c += begin;
+				n = end - begin;
+			}
+			if (m == 0 || n == 0) return;
+
+			if (!serial)
+			{
+				Gemm(m, n, k, a, lda, b, ldb, c, ldc);
+				return;
+			}
+			for (size_t i = 0; i < m; i += gemm_block_rows)
+			{
+				const size_t i_end = (m - i < gemm_block_rows) ? m : i + gemm_block_rows;
+				GemmRows(i, i_end, n, k, a, lda, b, ldb, c, ldc, false);
+			}
+		}
+
+		// shard counter and completion flags, shared with the workers
+		struct shard_control
+		{
+			std::atomic<uint32_t> next;
+
+			// one flag per shard follows the counter
+			std::atomic<uint8_t>* Done()
+			{
+				return reinterpret_cast<std::atomic<uint8_t>*>(this + 1);
+			}
+			static size_t Bytes(size_t shards)
+			{
+				return sizeof(shard_control) + shards * sizeof(std::atomic<uint8_t>);
+			}
+		};
+	}
+
+
+	// true when M's elements live in a shared segment of this process
+	template <typename T> bool IsShared(const matrix<T>& M)
+	{
+		return detail::shared_regions::Instance().Contains(M.Data());
+	}
+
+	// rows x columns zeroed elements in shared memory, anonymous (shared
+	// with forked children only) when name is empty, otherwise a new
+	// segment "/name" style for shm_open. Null when mapping fails, the
+	// name exists or the platform has no POSIX shared memory.
+	template <typename T> std::unique_ptr<matrix<T>> CreateSharedMatrix(unsigned int rows, unsigned int columns,
+		const std::string& name = std::string())
+	{
+#if defined(__linux__)
+		if (rows < 1) rows = 1;
+		if (columns < 1) columns = 1;
+		const size_t bytes = detail::shared_header_bytes + size_t(rows) * columns * sizeof(T);
+
+		void* memory = MAP_FAILED;
+		if (name.empty())
+		{
+			memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		}
+		else
+		{
+			const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+			if (fd < 0) return nullptr;
+			if (ftruncate(fd, off_t(bytes)) == 0)
+				memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			close(fd);
+			if (memory == MAP_FAILED) shm_unlink(name.c_str());
+		}
+		if (memory == MAP_FAILED) return nullptr;
+
+		// fresh mappings are zero filled, T(0) is assumed to be all zero bits
+		detail::shared_matrix_header* header = new (memory) detail::shared_matrix_header;
+		header->element_size = sizeof(T);
+		header->rows = rows;
+		header->columns = columns;
+		header->magic = detail::shared_matrix_magic;
+		return detail::AdoptSegment<T>(memory, bytes, name);
+#else
+		(void)rows;
+		(void)columns;
+		(void)name;
+		return nullptr;
+#endif
+	}
+
+	// attaches to a segment made by CreateSharedMatrix in any process,
+	// null when it doesn't exist or holds elements of another size
+	template <typename T> std::unique_ptr<matrix<T>> OpenSharedMatrix(const std::string& name)
+	{
+#if defined(__linux__)
+		const int fd = shm_open(name.c_str(), O_RDWR, 0);
+		if (fd < 0) return nullptr;
+
+		struct stat status;
+		void* memory = MAP_FAILED;
+		size_t bytes = 0u;
+		if (fstat(fd, &status) == 0 && size_t(status.st_size) >= detail::shared_header_bytes)
+		{
+			bytes = size_t(status.st_size);
+			memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		}
+		close(fd);
+		if (memory == MAP_FAILED) return nullptr;
+
+		const detail::shared_matrix_header* header = static_cast<const detail::shared_matrix_header*>(memory);
+		if (header->magic != detail::shared_matrix_magic || header->element_size != sizeof(T) ||
+			bytes < detail::shared_header_bytes + header->rows * header->columns * sizeof(T))
+		{
+			munmap(memory, bytes);
+			return nullptr;
+		}
+		return detail::AdoptSegment<T>(memory, bytes, std::string());
+#else
+		(void)name;
+		return nullptr;
+#endif
+	}
+
+	// Result = M1 * M2 sharded over worker processes, see above. Returns
+	// false (Result untouched) when the dimensions don't fit.
+	template <typename T>
+	bool ShardedGemm(const matrix<T>& M1, const matrix<T>& M2, matrix<T>& Result,
+		const shard_options& options = shard_options())
+	{
+		if (M1.GetColumns() != M2.GetRows() ||
+			Result.GetRows() != M1.GetRows() || Result.GetColumns() != M2.GetColumns())
+			return false;
+
+		const size_t extent = options.axis == shard_axis::rows ? Result.GetRows() : Result.GetColumns();
+		const size_t alignment = options.axis == shard_axis::rows ? 1u :
+			std::max<size_t>(1u, detail::shard_column_alignment / sizeof(T));
+
+		size_t processes = options.processes ? options.processes : std::max(1u, std::thread::hardware_concurrency());
+		size_t shards = options.shards ? options.shards : processes * 4u;
+		shards = std::min(shards, (extent + alignment - 1) / alignment);
+		processes = std::min(processes, shards);
+
+		std::vector<uint8_t> finished(shards, 0u);
+#if defined(__linux__)
+		if (processes > 1u && IsShared(Result))
+		{
+			const size_t control_bytes = detail::shard_control::Bytes(shards);
+			void* memory = mmap(nullptr, control_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+			if (memory != MAP_FAILED)
+			{
+				detail::shard_control* control = new (memory) detail::shard_control;
+				control->next.store(0u);
+				std::atomic<uint8_t>* done = control->Done();
+				for (size_t s = 0; s < shards; s++)
+					new (done + s) std::atomic<uint8_t>(0u);
+
+				std::vector<pid_t> workers;
+				workers.reserve(processes);
+				for (size_t w = 0; w < processes; w++)
+				{
+					const pid_t pid = fork();
+					if (pid == 0)
+					{
+						// the serial kernel only: no allocation, no pool, no locks
+						uint32_t s;
+						while ((s = control->next.fetch_add(1u)) < shards)
+						{
+							detail::GemmShard(M1, M2, Result, options.axis,
+								detail::ShardBoundary(extent, s, shards, alignment),
+								detail::ShardBoundary(extent, s + 1u, shards, alignment), true);
+							done[s].store(1u, std::memory_order_release);
+						}
+						_exit(0);
+					}
+					if (pid > 0) workers.push_back(pid);
+				}
+				const double shard_madds = double(Result.GetRows()) * Result.GetColumns() * M1.GetColumns() / double(shards);
+				const unsigned int stall_timeout_ms = options.stall_timeout_ms ? options.stall_timeout_ms :
+					1000u + unsigned(std::min(shard_madds / 1e5, 3.6e6));
+
+				// poll, restarting the clock whenever another shard is done
+				size_t completed = 0u;
+				std::chrono::steady_clock::time_point progress = std::chrono::steady_clock::now();
+				while (!workers.empty())
+				{
+					for (size_t w = 0; w < workers.size();)
+					{
+						int status = 0;
+						const pid_t result = waitpid(workers[w], &status, WNOHANG);
+						if (result == workers[w] || (result < 0 && errno == ECHILD))
+						{
+							workers[w] = workers.back();
+							workers.pop_back();
+						}
+						else w++;
+					}
+					if (workers.empty()) break;
+
+					size_t now_completed = 0u;
+					for (size_t s = 0; s < shards; s++)
+						now_completed += done[s].load(std::memory_order_relaxed);
+					if (now_completed != completed)
+					{
+						completed = now_completed;
+						progress = std::chrono::steady_clock::now();
+					}
+					else if (std::chrono::steady_clock::now() - progress >= std::chrono::milliseconds(stall_timeout_ms))
+					{
+						for (pid_t pid : workers)
+						{
+							kill(pid, SIGKILL);
+							int status = 0;
+							while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+						}
+						workers.clear();
+						break;
+					}
+					std::this_thread::sleep_for(std::chrono::milliseconds(detail::shard_poll_ms));
+				}
+				for (size_t s = 0; s < shards; s++)
+					finished[s] = done[s].load(std::memory_order_acquire);
+				munmap(memory, control_bytes);
+			}
+		}
+#endif
+
+		// whatever the workers left, on this process's pool
+		for (size_t s = 0; s < shards; s++)
+		{
+			if (!finished[s])
+			{
+				detail::GemmShard(M1, M2, Result, options.axis,
+					detail::ShardBoundary(extent, s, shards, alignment),
+					detail::ShardBoundary(extent, s + 1u, shards, alignment), false);
+			}
+		}
+		return true;
+	}
+}
+
+#endif // !SHARED_MATRIX_H
@@ -0,0 +1,278 @@
+#ifndef SPATIAL_SORT_H
+#define SPATIAL_SORT_H
+
+#include "parallel.h"
+#include "reduction.h"
+#include "vec3.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// pdep spreads the bits in one instruction on Intel since Haswell, AMD
+// before Zen 3 runs it in microcode, define MATH_NO_PDEP there
+#if !defined(MATH_NO_PDEP) && (defined(__BMI2__) || (defined(_MSC_VER) && defined(__AVX2__)))
+#define MATH_MORTON_PDEP
+#include <immintrin.h>
+#endif
+
+namespace Math
+{
+	// Keys along a space filling curve for vec3 point sets and a parallel
+	// radix sort giving the permutation into curve order, so points and
+	// any attribute arrays can be reordered for locality with
+	// ApplyPermutation. Coordinates are quantized against bounds to 10
+	// bits per axis for 30-bit keys (uint32_t) or 21 bits for 63-bit keys
+	// (uint64_t). Hilbert keys cost a few more operations per point and
+	// have no jumps between neighbouring cells.
+
+	enum class space_filling_curve
+	{
+		morton,
+		hilbert
+	};
+
+	namespace detail
+	{
+		constexpr size_t spatial_grain = 1u << 15;
+		constexpr size_t radix_grain = 1u << 16;
+
+		// bit i of v to bit 3 i
+		inline uint32_t SpreadBits3(uint32_t v)
+		{
+#ifdef MATH_MORTON_PDEP
+			return _pdep_u32(v, 0x09249249u);
+#else
+			v &= 0x3FFu;
+			v = (v | (v << 16)) & 0x030000FFu;
+			v = (v | (v << 8)) & 0x0300F00Fu;
+			v = (v | (v << 4)) & 0x030C30C3u;
+			v = (v | (v << 2)) & 0x09249249u;
+			return v;
+#endif
+		}
+		inline uint64_t SpreadBits3(uint64_t v)
+		{
+#ifdef MATH_MORTON_PDEP
+			return _pdep_u64(v, 0x1249249249249249ull);
+#else
+			v &= 0x1FFFFFull;
+			v = (v | (v << 32)) & 0x001F00000000FFFFull;
+			v = (v | (v << 16)) & 0x001F0000FF0000FFull;
+			v = (v | (v << 8)) & 0x100F00F00F00F00Full;
+			v = (v | (v << 4)) & 0x10C30C30C30C30C3ull;
+			v = (v | (v << 2)) & 0x1249249249249249ull;
+			return v;
+#endif
+		}
+
+		template <typename K> struct key_traits;
+		template <> struct key_traits<uint32_t>
+		{
+			static constexpr unsigned int bits = 10u;
+		};
+		template <> struct key_traits<uint64_t>
+		{
+			static constexpr unsigned int bits = 21u;
+		};
+
+		// Skilling's transform ("Programming the Hilbert curve", 2004) of
+		// cell coordinates to the transposed Hilbert index
+		inline void HilbertTranspose(uint32_t x[3], unsigned int bits)
+		{
+			const uint32_t m = 1u << (bits - 1u);
+			for (uint32_t q = m; q > 1u; q >>= 1)
+			{
+				const uint32_t p = q - 1u;
+				for (unsigned int i = 0; i < 3; i++)
+				{
+					if (x[i] & q)
+					{
+						x[0] ^= p;
+					}
+					else
+					{
+						const uint32_t t = (x[0] ^ x[i]) & p;
+						x[0] ^= t;
+						x[i] ^= t;
+					}
+				}
+			}
+			x[1] ^= x[0];
+			x[2] ^= x[1];
+			uint32_t t = 0u;
+			for (uint32_t q = m; q > 1u; q >>= 1)
+			{
+				if (x[2] & q) t ^= q - 1u;
+			}
+			x[0] ^= t;
+			x[1] ^= t;
+			x[2] ^= t;
+		}
+
+		template <typename K> K InterleaveCell(uint32_t x, uint32_t y, uint32_t z)
+		{
+			return (SpreadBits3(K(x)) << 2) | (SpreadBits3(K(y)) << 1) | SpreadBits3(K(z));
+		}
+
+		template <typename K, typename T> void SpatialKeysRange(const vec3<T>* points, size_t begin, size_t end,
+			const bounds<vec3<T>>& box, K* keys, space_filling_curve curve)
+		{
+			const unsigned int bits = key_traits<K>::bits;
+			const T cells = T((1u << bits) - 1u);
+			const vec3<T> extent = box.max - box.min;
+			const T sx = extent.x > T(0) ? cells / extent.x : T(0);
+			const T sy = extent.y > T(0) ? cells / extent.y : T(0);
+			const T sz = extent.z > T(0) ? cells / extent.z : T(0);
+
+			for (size_t i = begin; i < end; i++)
+			{
+				// clamped before the conversion, NaN ends up in cell 0
+				T c[3] = { (points[i].x - box.min.x) * sx, (points[i].y - box.min.y) * sy, (points[i].z - box.min.z) * sz };
+				uint32_t cell[3];
+				for (unsigned int a = 0; a < 3; a++)
+				{
+					const T v = c[a] > T(0) ? (c[a] < cells ? c[a] : cells) : T(0);
+					cell[a] = uint32_t(v);
+				}
+				if (curve == space_filling_curve::hilbert)
+					HilbertTranspose(cell, bits);
+				keys[i] = InterleaveCell<K>(cell[0], cell[1], cell[2]);
+			}
+		}
+	}
+
+
+	// 30-bit Morton code of cell coordinates below 1024 (x most significant)
+	inline uint32_t MortonCode30(uint32_t x, uint32_t y, uint32_t z)
+	{
+		return detail::InterleaveCell<uint32_t>(x, y, z);
+	}
+	// 63-bit Morton code of cell coordinates below 2^21
+	inline uint64_t MortonCode63(uint32_t x, uint32_t y, uint32_t z)
+	{
+		return detail::InterleaveCell<uint64_t>(x, y, z);
+	}
+	// Hilbert index of cell coordinates below 2^bits, bits <= 21
+	inline uint64_t HilbertCode(uint32_t x, uint32_t y, uint32_t z, unsigned int bits)
+	{
+		uint32_t cell[3] = { x, y, z };
+		detail::HilbertTranspose(cell, bits);
+		return detail::InterleaveCell<uint64_t>(cell[0], cell[1], cell[2]);
+	}
+
+	// keys of count points quantized against box, K uint32_t (30-bit)
+	// or uint64_t (63-bit)
+	template <typename K, typename T> void SpatialKeys(const vec3<T>* points, size_t count,
+		const bounds<vec3<T>>& box, K* keys, space_filling_curve curve = space_filling_curve::morton)
+	{
+		ParallelFor(count, detail::spatial_grain, [points, &box, keys, curve](size_t begin, size_t end)
+			{
+				detail::SpatialKeysRange(points, begin, end, box, keys, curve);
+			});
+	}
+
+	// Stable LSD radix sort of count keys by 8-bit digits, permutation[i]
+	// is the index of the i-th smallest key. Chunks of the input count
+	// and scatter their digits in parallel; digits all keys share are
+	// skipped, so 30-bit keys take at most 4 passes. Indices are 32-bit.
+	template <typename K> void RadixSort(const K* keys, size_t count, uint32_t* permutation, K* sorted_keys = nullptr)
+	{
+		const size_t chunks = (count + detail::radix_grain - 1) / detail::radix_grain;
+		std::vector<K> key_buffer[2] = { std::vector<K>(keys, keys + count), std::vector<K>(count) };
+		std::vector<uint32_t> index_buffer[2] = { std::vector<uint32_t>(count), std::vector<uint32_t>(count) };
+		std::vector<size_t> offsets(chunks * 256u);
+		for (size_t i = 0; i < count; i++)
+			index_buffer[0][i] = uint32_t(i);
+
+		unsigned int current = 0u;
+		for (unsigned int shift = 0; shift < sizeof(K) * 8u; shift += 8u)
+		{
+			const K* source_keys = key_buffer[current].data();
+			size_t* histograms = offsets.data();
+			ParallelForChunks(count, detail::radix_grain, [source_keys, histograms, shift](size_t chunk, size_t begin, size_t end)
+				{
+					size_t* histogram = histograms + chunk * 256u;
+					for (unsigned int d = 0; d < 256u; d++)
+						histogram[d] = 0u;
+					for (size_t i = begin; i < end; i++)
+						histogram[(source_keys[i] >> shift) & 0xFFu]++;
+				});
+
+			// exclusive prefix sum, digit major and chunk minor for stability
+			size_t sum = 0u;
+			bool trivial = false;
+			for (unsigned int d = 0; d < 256u; d++)
+			{
+				const size_t digit_begin = sum;
+				for (size_t c = 0; c < chunks; c++)
+				{
+					const size_t n = histograms[c * 256u + d];
+					histograms[c * 256u + d] = sum;
+					sum += n;
+				}
+				if (sum - digit_begin == count) trivial = true;
+			}
+			if (trivial) continue;
+
+			const uint32_t* source_indices = index_buffer[current].data();
+			K* target_keys = key_buffer[current ^ 1u].data();
+			uint32_t* target_indices = index_buffer[current ^ 1u].data();
+			ParallelForChunks(count, detail::radix_grain,
+				[source_keys, source_indices, target_keys, target_indices, histograms, shift](size_t chunk, size_t begin, size_t end)
+				{
+					size_t* offset = histograms + chunk * 256u;
+					for (size_t i = begin; i < end; i++)
+					{
+						const size_t position = offset[(source_keys[i] >> shift) & 0xFFu]++;
+						target_keys[position] = source_keys[i];
+						target_indices[position] = source_indices[i];
+					}
+				});
+			current ^= 1u;
+		}
+
+		for (size_t i = 0; i < count; i++)
+			permutation[i] = index_buffer[current][i];
+		if (sorted_keys)
+		{
+			for (size_t i = 0; i < count; i++)
+				sorted_keys[i] = key_buffer[current][i];
+		}
+	}
+
+	// permutation into curve order over the bounds of the points; 63-bit
+	// keys when wide_keys is set
+	template <typename T> void SpatialSort(const vec3<T>* points, size_t count, std::vector<uint32_t>& permutation,
+		space_filling_curve curve = space_filling_curve::morton, bool wide_keys = false)
+	{
+		permutation.resize(count);
+		if (count == 0u) return;
+
+		const bounds<vec3<T>> box = Bounds(points, count);
+		if (wide_keys)
+		{
+			std::vector<uint64_t> keys(count);
+			SpatialKeys(points, count, box, keys.data(), curve);
+			RadixSort(keys.data(), count, permutation.data());
+		}
+		else
+		{
+			std::vector<uint32_t> keys(count);
+			SpatialKeys(points, count, box, keys.data(), curve);
+			RadixSort(keys.data(), count, permutation.data());
+		}
+	}
+
+	// out[i] = in[permutation[i]], out must not alias in
+	template <typename A> void ApplyPermutation(const A* in, A* out, const uint32_t* permutation, size_t count)
+	{
+		ParallelFor(count, detail::spatial_grain, [in, out, permutation](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+					out[i] = in[permutation[i]];
+			});
+	}
+}
+
+#endif // !SPATIAL_SORT_H
@@ -1,9 +1,21 @@
+#include <algorithm>
 #include <iostream>
 #include <chrono>
+#include <cmath>
+#include <string>
 
 #include "vec3.h"
-#include "constants.h"
+#include "Constants.h"
 #include "angle.h"
+#include "convolution.h"
+#include "gemm.h"
+#include "quantized.h"
+#include "shared_matrix.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <signal.h>
+#endif
 
 using namespace Math;
 
@@ -12,15 +24,158 @@ void PrintVec(const Math::vec3f& v)
 	std::cout << "[" << v.x << ", " << v.y << ", " << v.z << "]" << std::endl;
 }
 
+int failures = 0;
+void Check(bool passed, const std::string& what)
+{
+	std::cout << (passed ? "passed: " : "FAILED: ") << what << std::endl;
+	if (!passed) failures++;
+}
+
+template <typename T> T MaxDifference(matrix<T>& A, matrix<T>& B)
+{
+	if (A.GetRows() != B.GetRows() || A.GetColumns() != B.GetColumns())
+		return T(1e30);
+	T difference = T(0);
+	for (unsigned int i = 0; i < A.GetRows(); i++)
+		for (unsigned int j = 0; j < A.GetColumns(); j++)
+			difference = std::max(difference, T(std::fabs(A(i, j) - B(i, j))));
+	return difference;
+}
+
+#if defined(__linux__)
+// forked children stop themselves while set, so ShardedGemm has to kill
+// its workers and compute their shards itself
+volatile sig_atomic_t stop_forked_children = 0;
+void StopForkedChild()
+{
+	if (stop_forked_children) raise(SIGSTOP);
+}
+#endif
+
+void TestShardedGemm()
+{
+	const unsigned int n = 200u;
+	std::unique_ptr<matrix<double>> A = CreateSharedMatrix<double>(n, n);
+	std::unique_ptr<matrix<double>> B = CreateSharedMatrix<double>(n, n);
+	std::unique_ptr<matrix<double>> C = CreateSharedMatrix<double>(n, n);
+	if (!A || !B || !C)
+	{
+		std::cout << "skipped: ShardedGemm, no shared memory" << std::endl;
+		return;
+	}
+	for (unsigned int i = 0; i < n; i++)
+	{
+		for (unsigned int j = 0; j < n; j++)
+		{
+			(*A)(i, j) = double((i * 7u + j * 3u) % 13u) - 6.0;
+			(*B)(i, j) = double((i + 2u * j) % 5u) * 0.5;
+		}
+	}
+	matrix<double> Expected(n, n);
+	Gemm(*A, *B, Expected);
+
+	const shard_axis axes[] = { shard_axis::rows, shard_axis::columns };
+	for (shard_axis axis : axes)
+	{
+		shard_options options;
+		options.processes = 3u;
+		options.axis = axis;
+		const bool done = ShardedGemm(*A, *B, *C, options);
+		Check(done && MaxDifference(*C, Expected) == 0.0,
+			std::string("ShardedGemm over ") + (axis == shard_axis::rows ? "rows" : "columns"));
+	}
+
+	// the result seen by name from another attachment
+	const std::string name = "/math_tester_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+	std::unique_ptr<matrix<double>> Named = CreateSharedMatrix<double>(n, n, name);
+	std::unique_ptr<matrix<double>> Attached = OpenSharedMatrix<double>(name);
+	if (Named && Attached)
+	{
+		shard_options options;
+		options.processes = 2u;
+		ShardedGemm(*A, *B, *Named, options);
+		Check(MaxDifference(*Attached, Expected) == 0.0, "ShardedGemm into a segment attached by name");
+	}
+
+#if defined(__linux__)
+	// stopped workers are killed and their shards computed by the caller
+	for (unsigned int i = 0; i < n; i++)
+		for (unsigned int j = 0; j < n; j++)
+			(*C)(i, j) = -1.0;
+	shard_options options;
+	options.processes = 2u;
+	options.shards = 16u;
+	options.stall_timeout_ms = 100u;
+	pthread_atfork(nullptr, nullptr, StopForkedChild);
+	stop_forked_children = 1;
+	ShardedGemm(*A, *B, *C, options);
+	stop_forked_children = 0;
+	Check(MaxDifference(*C, Expected) == 0.0, "ShardedGemm with stopped workers");
+#endif
+}
+
+void TestQuantizeSaturation()
+{
+	const float values[] = { 1e10f, -1e10f, 3e9f, std::nanf(""), 2.4f };
+	matrix<float> M(1, 5);
+	for (unsigned int j = 0; j < 5u; j++)
+		M(0, j) = values[j];
+
+	const qmatrix<int8_t> Signed = Quantize<int8_t>(M, 1.0f, 0);
+	const qmatrix<uint8_t> Unsigned = Quantize<uint8_t>(M, 1.0f, 10);
+	Check(Signed.Value(0, 0) == 127 && Signed.Value(0, 1) == -128 && Signed.Value(0, 2) == 127 &&
+		Signed.Value(0, 3) == 0 && Signed.Value(0, 4) == 2, "Quantize<int8_t> saturates, NaN to the zero point");
+	Check(Unsigned.Value(0, 0) == 255 && Unsigned.Value(0, 1) == 0 && Unsigned.Value(0, 2) == 255 &&
+		Unsigned.Value(0, 3) == 10 && Unsigned.Value(0, 4) == 12, "Quantize<uint8_t> saturates, NaN to the zero point");
+}
+
+void TestCorrelateInPlace()
+{
+	matrix<float> Image(40, 40);
+	for (unsigned int i = 0; i < 40u; i++)
+		for (unsigned int j = 0; j < 40u; j++)
+			Image(i, j) = float((i * 7u + j * 3u) % 11u) - 5.0f;
+	matrix<float> Kernel(3, 3);
+	for (unsigned int i = 0; i < 3u; i++)
+		for (unsigned int j = 0; j < 3u; j++)
+			Kernel(i, j) = float(i + 1u) * float(j + 2u);
+
+	// a resized output (no padding) and one of the input's shape
+	const convolution_options paddings[] = { convolution_options(), SamePadding(Kernel) };
+	const convolution_strategy strategies[] = {
+		convolution_strategy::direct, convolution_strategy::separable,
+		convolution_strategy::im2col, convolution_strategy::fft };
+	for (const convolution_options& padding : paddings)
+	{
+		for (convolution_strategy strategy : strategies)
+		{
+			convolution_options options = padding;
+			options.strategy = strategy;
+			matrix<float> Expected(1, 1);
+			Correlate(Image, Kernel, Expected, options);
+			matrix<float> InPlace(Image);
+			const bool done = Correlate(InPlace, Kernel, InPlace, options);
+			Check(done && MaxDifference(InPlace, Expected) == 0.0f,
+				"Correlate in place, strategy " + std::to_string(int(strategy)) +
+				(padding.pad_rows ? ", same padding" : ", no padding"));
+		}
+	}
+}
+
 int main()
 {
 	vec3f a(1.0f, 0.0f, 4.0f);
 	vec3f b(1.0f, 0.0f, 4.0f);
 	PrintVec(a);
 	PrintVec(b);
-	std::cout << (a != b);
+	std::cout << (a != b) << std::endl;
+
+	TestShardedGemm();
+	TestQuantizeSaturation();
+	TestCorrelateInPlace();
+	std::cout << failures << " failed" << std::endl;
 
 	std::cin.get();
 
-	return 0;
-}
\ No newline at end of file
+	return failures ? 1 : 0;
+}